@@ -0,0 +1,257 @@
+#include "rsbench.h"
+
+////////////////////////////////////////////////////////////////////////////////////
+// BATCH LOOKUPS (HOST)
+////////////////////////////////////////////////////////////////////////////////////
+// Transport codes with many tallies often need the macroscopic XS of several
+// materials at the same energy. Looking the materials up one at a time
+// recomputes the micro XS of every nuclide they share once per material,
+// which in RSBench means summing over the poles of the nuclide's window again.
+// calculate_macro_xs_batch computes each distinct nuclide once (per material
+// temperature), and scatters its micro XS into all the materials containing
+// it.
+//
+// This samples lookups on the host like the event based simulation does, and
+// evaluates each energy against a batch of materials: the sampled material,
+// followed by the next batch_mats - 1 materials (cyclically). The batches
+// are looked up one material at a time with calculate_macro_xs, then with
+// calculate_macro_xs_batch, and the lookups/s are compared. The verification
+// hash is that of the sampled materials, so it matches the event based
+// simulation.
+////////////////////////////////////////////////////////////////////////////////////
+
+// Samples the energy and the batch of materials of lookup i
+static void batch_sample( unsigned long i, int batch_mats, double * E, int * mats )
+{
+	// Sample exactly like the event based kernel does
+	uint64_t seed = fast_forward_LCG(STARTING_SEED, 2*i);
+	*E = LCG_random_double(&seed);
+	int mat = pick_mat(&seed);
+
+	for( int b = 0; b < batch_mats; b++ )
+		mats[b] = ( mat + b ) % N_MATERIALS;
+}
+
+// Calculates the macroscopic cross sections of n_batch materials (batch_mats)
+// at the same energy, storing those of batch_mats[b] in macro_xs[4*b .. 4*b+3].
+// Many nuclides appear in several materials (e.g., 24, 41, 4 and 5 are in
+// every water bearing material), so instead of looking each material up in
+// turn, the distinct nuclides of the batch are looked up once each, and every
+// micro XS is scattered into the macro XS of all batch materials containing
+// the nuclide, using the nuclide to material incidence structure (see
+// load_nuc_mats). The terms of each macro XS are summed in a different order
+// than by calculate_macro_xs, so the results can differ from it in the last
+// bits.
+//
+// With Doppler broadening, the micro XS of a nuclide also depends on the
+// temperature of the material, so it is only shared by the materials at the
+// same temperature: the batch is processed one temperature at a time (a
+// single pass with uniform temperatures, or without Doppler broadening).
+static void calculate_macro_xs_batch( double * macro_xs, int n_batch, int * batch_mats, double E, Input input, int * num_nucs, int * mats, int max_num_nucs, int * nuc_mat_offsets, int * nuc_mat_mats, double * nuc_mat_concs, int * n_windows, double * pseudo_K0Rs, Window * windows, Pole * poles, int * window_offsets, int * pole_offsets, double * curvefit, double * poles_soa, short * pole_l_values, RSComplex * faddeeva_table, double * dopp )
+{
+	// Position of each material in the batch (-1 if not in it). A material
+	// listed more than once is computed at its last position.
+	int slot[N_MATERIALS];
+	for( int m = 0; m < N_MATERIALS; m++ )
+		slot[m] = -1;
+	for( int b = 0; b < n_batch; b++ )
+	{
+		assert( batch_mats[b] >= 0 && batch_mats[b] < N_MATERIALS );
+		slot[batch_mats[b]] = b;
+		for( int j = 0; j < 4; j++ )
+			macro_xs[b * 4 + j] = 0;
+	}
+
+	// Batch materials still to be computed
+	int pending[n_batch];
+	for( int b = 0; b < n_batch; b++ )
+		pending[b] = ( slot[batch_mats[b]] == b );
+
+	int nucs[input.n_nuclides];
+	uint64_t done[(input.n_nuclides + 63) / 64];
+	for( int g = 0; g < n_batch; g++ )
+	{
+		if( !pending[g] )
+			continue;
+
+		// Distinct nuclides of the pending materials at the temperature of
+		// material batch_mats[g]
+		double group_dopp = dopp[batch_mats[g]];
+		int group[N_MATERIALS];
+		for( int m = 0; m < N_MATERIALS; m++ )
+			group[m] = 0;
+		memset( done, 0, sizeof(done) );
+		int n_nucs = 0;
+		for( int b = g; b < n_batch; b++ )
+		{
+			int mat = batch_mats[b];
+			if( !pending[b] || ( input.doppler == 1 && dopp[mat] != group_dopp ) )
+				continue;
+			pending[b] = 0;
+			group[mat] = 1;
+			for( int i = 0; i < num_nucs[mat]; i++ )
+			{
+				int nuc = mats[mat * max_num_nucs + i];
+				if( !( done[nuc / 64] & ( 1ULL << (nuc % 64) ) ) )
+					nucs[n_nucs++] = nuc;
+				done[nuc / 64] |= 1ULL << (nuc % 64);
+			}
+		}
+
+		// Micro XS of each distinct nuclide
+		double micro_xs[n_nucs][4];
+		for( int n = 0; n < n_nucs; n++ )
+		{
+			if( input.pole_layout == POLES_SOA )
+			{
+				if( input.doppler == 1 )
+					calculate_micro_xs_doppler_soa( micro_xs[n], nucs[n], E, input, n_windows, pseudo_K0Rs, windows, poles_soa, pole_l_values, window_offsets, pole_offsets, curvefit, faddeeva_table, group_dopp);
+				else
+					calculate_micro_xs_soa( micro_xs[n], nucs[n], E, input, n_windows, pseudo_K0Rs, windows, poles_soa, pole_l_values, window_offsets, pole_offsets, curvefit);
+			}
+			else if( input.doppler == 1 )
+				calculate_micro_xs_doppler( micro_xs[n], nucs[n], E, input, n_windows, pseudo_K0Rs, windows, poles, window_offsets, pole_offsets, curvefit, faddeeva_table, group_dopp);
+			else
+				calculate_micro_xs( micro_xs[n], nucs[n], E, input, n_windows, pseudo_K0Rs, windows, poles, window_offsets, pole_offsets, curvefit);
+		}
+
+		// Scatter each micro XS into every material of the group containing
+		// the nuclide
+		for( int n = 0; n < n_nucs; n++ )
+			for( int e = nuc_mat_offsets[nucs[n]]; e < nuc_mat_offsets[nucs[n] + 1]; e++ )
+			{
+				int mat = nuc_mat_mats[e];
+				if( !group[mat] )
+					continue;
+				for( int j = 0; j < 4; j++ )
+					macro_xs[slot[mat] * 4 + j] += micro_xs[n][j] * nuc_mat_concs[e];
+			}
+	}
+
+	// Copies of materials listed more than once
+	for( int b = 0; b < n_batch; b++ )
+	{
+		int s = slot[batch_mats[b]];
+		if( s != b )
+			for( int j = 0; j < 4; j++ )
+				macro_xs[b * 4 + j] = macro_xs[s * 4 + j];
+	}
+}
+
+// Looks up the batch of lookup i, one material at a time or as a batch
+static void batch_lookup( Input input, SimulationData SD, double E, int * mats, int use_batch, double * macro_xs )
+{
+	if( use_batch )
+		calculate_macro_xs_batch( macro_xs, input.batch_mats, mats, E, input, SD.num_nucs, SD.mats, SD.max_num_nucs,
+		                          SD.nuc_mat_offsets, SD.nuc_mat_mats, SD.nuc_mat_concs, SD.n_windows, SD.pseudo_K0RS,
+		                          SD.windows, SD.poles, SD.window_offsets, SD.pole_offsets, SD.curvefit, SD.poles_soa,
+		                          SD.pole_l_values, SD.faddeeva_table, SD.dopp );
+	else
+		for( int b = 0; b < input.batch_mats; b++ )
+			calculate_macro_xs( &macro_xs[b * 4], mats[b], E, input, SD.num_nucs, SD.mats, SD.max_num_nucs, SD.concs,
+			                    SD.n_windows, SD.pseudo_K0RS, SD.windows, SD.poles, SD.window_offsets, SD.pole_offsets,
+			                    SD.curvefit, SD.poles_soa, SD.pole_l_values, SD.faddeeva_table, SD.dopp );
+}
+
+// Runs all lookups, and returns the verification hash
+static unsigned long long batch_run_lookups( Input input, SimulationData SD, int use_batch, double * rate )
+{
+	unsigned long long validation_hash = 0;
+	double start = get_time();
+
+	#pragma omp parallel for schedule(static) reduction(+:validation_hash)
+	for( unsigned long i = 0; i < input.lookups; i++ )
+	{
+		double E;
+		int mats[N_MATERIALS];
+		batch_sample( i, input.batch_mats, &E, mats );
+
+		double macro_xs[N_MATERIALS * 4];
+		batch_lookup( input, SD, E, mats, use_batch, macro_xs );
+
+		// Verification of the sampled material (the first of the batch)
+		double max = -DBL_MAX;
+		int max_idx = 0;
+		for(int x = 0; x < 4; x++ )
+		{
+			if( macro_xs[x] > max )
+			{
+				max = macro_xs[x];
+				max_idx = x;
+			}
+		}
+		validation_hash += max_idx+1;
+	}
+
+	*rate = input.lookups / ( get_time() - start );
+	return validation_hash;
+}
+
+void run_batch_simulation( Input input, SimulationData SD, unsigned long * vhash_result )
+{
+	printf("Beginning batch lookup comparison on host...\n");
+
+	double per_material_rate, batch_rate;
+	unsigned long long per_material_hash = batch_run_lookups( input, SD, 0, &per_material_rate );
+	unsigned long long validation_hash = batch_run_lookups( input, SD, 1, &batch_rate );
+
+	// Compares the XS of both methods on a subset of the lookups, and counts
+	// the micro XS each of them computes
+	unsigned long n_check = ( input.lookups < BATCH_CHECK_LOOKUPS ) ? input.lookups : BATCH_CHECK_LOOKUPS;
+	double max_diff = 0;
+	unsigned long long per_material_micro = 0, batch_micro = 0;
+	#pragma omp parallel for schedule(static) reduction(max:max_diff) reduction(+:per_material_micro,batch_micro)
+	for( unsigned long i = 0; i < n_check; i++ )
+	{
+		double E;
+		int mats[N_MATERIALS];
+		batch_sample( i, input.batch_mats, &E, mats );
+
+		double ref[N_MATERIALS * 4], xs[N_MATERIALS * 4];
+		batch_lookup( input, SD, E, mats, 0, ref );
+		batch_lookup( input, SD, E, mats, 1, xs );
+		for( int k = 0; k < input.batch_mats * 4; k++ )
+		{
+			double diff = fabs( xs[k] - ref[k] );
+			if( ref[k] != 0 )
+				diff /= fabs( ref[k] );
+			if( diff > max_diff )
+				max_diff = diff;
+		}
+
+		// A micro XS is shared by the materials at the same temperature
+		// (all of them without Doppler broadening)
+		char seen[N_MATERIALS][input.n_nuclides];
+		memset( seen, 0, sizeof(seen) );
+		for( int b = 0; b < input.batch_mats; b++ )
+		{
+			int group = mats[b];
+			for( int c = 0; c < b; c++ )
+				if( input.doppler == 0 || SD.dopp[mats[c]] == SD.dopp[mats[b]] )
+				{
+					group = mats[c];
+					break;
+				}
+			for( int k = 0; k < SD.num_nucs[mats[b]]; k++ )
+			{
+				int nuc = SD.mats[mats[b] * SD.max_num_nucs + k];
+				per_material_micro++;
+				if( !seen[group][nuc] )
+					batch_micro++;
+				seen[group][nuc] = 1;
+			}
+		}
+	}
+
+	printf("Materials per Lookup:        %d\n", input.batch_mats);
+	printf("Micro XS per Lookup:         %.2lf (per material), %.2lf (batch)\n",
+	       (double) per_material_micro / n_check, (double) batch_micro / n_check);
+	printf("Per Material Lookups/s:      "); fancy_int(per_material_rate);
+	printf("Batch Lookups/s:             "); fancy_int(batch_rate);
+	printf("Batch/Per Material:          %.3lf\n", batch_rate / per_material_rate);
+	printf("Max Relative XS Difference:  %.3e\n", max_diff);
+	if( validation_hash != per_material_hash )
+		printf("Warning: batch and per material lookups gave different verification hashes!\n");
+
+	*vhash_result = validation_hash;
+}
@@ -0,0 +1,136 @@
+#include "rsbench.h"
+
+////////////////////////////////////////////////////////////////////////////////////
+// DEVICE DATA BROADCAST
+////////////////////////////////////////////////////////////////////////////////////
+// By default (-D map), every kernel maps all of its arrays to every device
+// from the host, so a run with N devices makes N full host to device
+// transfers, which all compete for the host link. With -D bcast, the arrays
+// are explicitly allocated on each device (omp_target_alloc), copied once from
+// the host to device 0, and then broadcast from device to device along a
+// binomial tree: in each round, every device that already holds the data
+// copies it to one that does not, so N devices are filled in log2(N) rounds.
+//
+// The device copies are associated with the host arrays
+// (omp_target_associate_ptr), so the map clauses of the kernels find the data
+// already present and do not transfer it again. With -D persistent, the data
+// stays resident across all repeated kernel runs (-R), instead of being
+// broadcast again before each run.
+////////////////////////////////////////////////////////////////////////////////////
+
+// Host pointers to, and sizes in bytes of, all arrays read by the kernels
+static void device_arrays( SimulationData * SD, void ** ptr, size_t * bytes )
+{
+	ptr[0]  = SD->n_poles;        bytes[0]  = SD->length_n_poles * sizeof(int);
+	ptr[1]  = SD->n_windows;      bytes[1]  = SD->length_n_windows * sizeof(int);
+	ptr[2]  = SD->pole_offsets;   bytes[2]  = SD->length_pole_offsets * sizeof(int);
+	ptr[3]  = SD->window_offsets; bytes[3]  = SD->length_window_offsets * sizeof(int);
+	ptr[4]  = SD->poles;          bytes[4]  = ( SD->length_poles_soa > 0 ) ? 0 : SD->length_poles * sizeof(Pole); // Not read with the SoA layout
+	ptr[5]  = SD->poles_soa;      bytes[5]  = SD->length_poles_soa * sizeof(double);
+	ptr[6]  = SD->pole_l_values;  bytes[6]  = SD->length_pole_l_values * sizeof(short);
+	ptr[7]  = SD->windows;        bytes[7]  = SD->length_windows * sizeof(Window);
+	ptr[8]  = SD->curvefit;       bytes[8]  = SD->length_curvefit * sizeof(double);
+	ptr[9]  = SD->faddeeva_table; bytes[9]  = SD->length_faddeeva_table * sizeof(RSComplex);
+	ptr[10] = SD->dopp;           bytes[10] = SD->length_dopp * sizeof(double);
+	ptr[11] = SD->pseudo_K0RS;    bytes[11] = SD->length_pseudo_K0RS * sizeof(double);
+	ptr[12] = SD->num_nucs;       bytes[12] = SD->length_num_nucs * sizeof(int);
+	ptr[13] = SD->mats;           bytes[13] = SD->length_mats * sizeof(int);
+	ptr[14] = SD->concs;          bytes[14] = SD->length_concs * sizeof(double);
+}
+
+DeviceData device_data_broadcast( SimulationData SD )
+{
+	DeviceData DD;
+	DD.num_devices = omp_get_num_devices();
+	DD.bytes = 0;
+	DD.device_ptr = NULL;
+
+	if( DD.num_devices == 0 )
+	{
+		printf("NOTE - No devices available, device data is not broadcast.\n");
+		return DD;
+	}
+
+	double start = get_time();
+
+	int n = DD.num_devices;
+	int host_device = omp_get_initial_device();
+	void * host_ptr[DEVICE_DATA_ARRAYS];
+	size_t bytes[DEVICE_DATA_ARRAYS];
+	device_arrays( &SD, host_ptr, bytes );
+
+	DD.device_ptr = (void **) calloc( DEVICE_DATA_ARRAYS * n, sizeof(void *));
+	assert(DD.device_ptr != NULL);
+
+	#pragma omp parallel for num_threads(n)
+	for( int K = 0; K < n; K++ )
+		for( int a = 0; a < DEVICE_DATA_ARRAYS; a++ )
+			if( bytes[a] > 0 )
+			{
+				DD.device_ptr[a * n + K] = omp_target_alloc( bytes[a], K );
+				if( DD.device_ptr[a * n + K] == NULL )
+				{
+					printf("Error: could not allocate %zu bytes on device %d!\n", bytes[a], K);
+					exit(1);
+				}
+			}
+
+	// Host to device 0
+	for( int a = 0; a < DEVICE_DATA_ARRAYS; a++ )
+		if( bytes[a] > 0 )
+		{
+			omp_target_memcpy( DD.device_ptr[a * n], host_ptr[a], bytes[a], 0, 0, 0, host_device );
+			DD.bytes += bytes[a];
+		}
+
+	// Device to device, doubling the number of filled devices every round
+	for( int filled = 1; filled < n; filled *= 2 )
+	{
+		#pragma omp parallel for num_threads(filled)
+		for( int src = 0; src < filled; src++ )
+		{
+			int dst = src + filled;
+			if( dst >= n )
+				continue;
+			for( int a = 0; a < DEVICE_DATA_ARRAYS; a++ )
+				if( bytes[a] > 0 )
+					omp_target_memcpy( DD.device_ptr[a * n + dst], DD.device_ptr[a * n + src], bytes[a], 0, 0, dst, src );
+		}
+	}
+
+	// Associate the device copies with the host arrays, so that the kernels'
+	// map clauses use them in place
+	for( int K = 0; K < n; K++ )
+		for( int a = 0; a < DEVICE_DATA_ARRAYS; a++ )
+			if( bytes[a] > 0 && omp_target_associate_ptr( host_ptr[a], DD.device_ptr[a * n + K], bytes[a], 0, K ) != 0 )
+			{
+				printf("Error: could not associate device %d data with the host arrays!\n", K);
+				exit(1);
+			}
+
+	double stop = get_time();
+	printf("Broadcast %.1lf MB to %d devices. (%.3lf seconds)\n", DD.bytes / 1024.0 / 1024.0, n, stop - start);
+
+	return DD;
+}
+
+void device_data_release( SimulationData SD, DeviceData DD )
+{
+	int n = DD.num_devices;
+	if( n == 0 )
+		return;
+
+	void * host_ptr[DEVICE_DATA_ARRAYS];
+	size_t bytes[DEVICE_DATA_ARRAYS];
+	device_arrays( &SD, host_ptr, bytes );
+
+	for( int K = 0; K < n; K++ )
+		for( int a = 0; a < DEVICE_DATA_ARRAYS; a++ )
+			if( bytes[a] > 0 )
+			{
+				omp_target_disassociate_ptr( host_ptr[a], K );
+				omp_target_free( DD.device_ptr[a * n + K], K );
+			}
+
+	free(DD.device_ptr);
+}
@@ -0,0 +1,204 @@
+#include "rsbench.h"
+#include<complex.h>
+
+////////////////////////////////////////////////////////////////////////////////////
+// FADDEEVA EVALUATOR BENCHMARK
+////////////////////////////////////////////////////////////////////////////////////
+// Standalone microbenchmark of the Faddeeva function evaluators selectable
+// with -F. Each evaluator is timed (single threaded, on the host) on two sets
+// of arguments:
+//
+//   Kernel: Z sampled like the Doppler kernel does, Z = (E - E_pole) / 2,
+//           with E_pole = 152.5 (r + i im), so nearly all samples take the
+//           asymptotic branch
+//   Core:   Z uniform in the square |Re Z|, |Im Z| < 6 (the region where the
+//           evaluators differ)
+//
+// and its accuracy is measured against a reference evaluation (Weideman's
+// approximation with N = 64, in long double) over a grid of the upper
+// half-plane, and over the kernel samples (which lie in the lower half-plane,
+// where the reference uses W(Z) = -conj(w(conj(Z)))). The fastest evaluator
+// whose error on the kernel samples is within the tolerance is recommended.
+//
+// Usage: ./faddeeva-bench [tolerance] (defaults to 1e-4)
+////////////////////////////////////////////////////////////////////////////////////
+
+#define BENCH_SAMPLES (1 << 20)
+#define BENCH_REPEATS 10
+#define REF_N 64
+
+static long double ref_L;
+static long double ref_coeff[REF_N];
+
+// Coefficients of Weideman's approximation with REF_N terms, computed with a
+// (direct) discrete Fourier transform
+static void ref_init( void )
+{
+	int M = 2 * REF_N;
+	int M2 = 2 * M;
+	long double pi = 3.14159265358979323846264338327950288L;
+	ref_L = sqrtl( REF_N / sqrtl(2.0L) );
+
+	// f(t) sampled at t = L tan(k pi / 2M), k = -M+1 .. M-1, shifted so
+	// that k = 0 is the first sample (f is even in k)
+	long double f[4 * REF_N];
+	for( int j = 0; j < M2; j++ )
+	{
+		int k = ( j < M ) ? j : j - M2;
+		if( k == -M )
+		{
+			f[j] = 0;
+			continue;
+		}
+		long double t = ref_L * tanl( k * pi / (2 * M) );
+		f[j] = expl( -t * t ) * ( ref_L * ref_L + t * t );
+	}
+
+	for( int n = 1; n <= REF_N; n++ )
+	{
+		long double a = 0;
+		for( int j = 0; j < M2; j++ )
+			a += f[j] * cosl( 2 * pi * j * n / M2 );
+		ref_coeff[n-1] = a / M2;
+	}
+}
+
+// Reference w(z) (upper half-plane), or W(z) = -conj(w(conj(z))) below it
+static long double complex ref_W( RSComplex Z )
+{
+	long double complex z = Z.r + I * fabsl(Z.i);
+	long double complex lmiz = ref_L - I * z;
+	long double complex X = ( ref_L + I * z ) / lmiz;
+	long double complex p = ref_coeff[REF_N-1];
+	for( int n = REF_N - 2; n >= 0; n-- )
+		p = p * X + ref_coeff[n];
+	long double complex w = 2 * p / ( lmiz * lmiz ) + 0.564189583547756286948079451560772586L / lmiz;
+	if( Z.i < 0 )
+		w = -conjl(w);
+	return w;
+}
+
+static double rel_error( RSComplex W, long double complex ref )
+{
+	long double complex diff = ( W.r + I * W.i ) - ref;
+	return (double) ( cabsl(diff) / cabsl(ref) );
+}
+
+// Average time (in ns) of one evaluation over the samples
+static double time_evaluator( int evaluator, RSComplex * Z, RSComplex * table, double * sink )
+{
+	double s = 0;
+	double start = get_time();
+	for( int r = 0; r < BENCH_REPEATS; r++ )
+		for( int n = 0; n < BENCH_SAMPLES; n++ )
+		{
+			RSComplex W = faddeeva_W( Z[n], evaluator, table );
+			s += W.r + W.i;
+		}
+	double stop = get_time();
+	*sink += s;
+	return ( stop - start ) * 1e9 / ( (double) BENCH_REPEATS * BENCH_SAMPLES );
+}
+
+int main(int argc, char * argv[])
+{
+	double tolerance = ( argc > 1 ) ? atof(argv[1]) : 1e-4;
+	const char * names[FADDEEVA_EVALUATORS] = {"default", "fused", "humlicek", "weideman", "table"};
+
+	ref_init();
+	RSComplex zero = {0, 0};
+	RSComplex one_i = {0, 1};
+	printf("Reference w(0) = %.16Lf (exact 1), w(i) = %.16Lf (exact 0.4275835761558070)\n",
+	       creall(ref_W(zero)), creall(ref_W(one_i)));
+
+	RSComplex * table = generate_faddeeva_table();
+
+	// Samples
+	RSComplex * kernel_Z = (RSComplex *) malloc( BENCH_SAMPLES * sizeof(RSComplex));
+	RSComplex * core_Z = (RSComplex *) malloc( BENCH_SAMPLES * sizeof(RSComplex));
+	assert(kernel_Z != NULL && core_Z != NULL);
+	uint64_t seed = STARTING_SEED;
+	for( int n = 0; n < BENCH_SAMPLES; n++ )
+	{
+		double E = LCG_random_double(&seed);
+		double r = LCG_random_double(&seed);
+		double im = LCG_random_double(&seed);
+		kernel_Z[n].r = 0.5 * ( E - 152.5 * r );
+		kernel_Z[n].i = -0.5 * 152.5 * im;
+		core_Z[n].r = 12.0 * LCG_random_double(&seed) - 6.0;
+		core_Z[n].i = 12.0 * LCG_random_double(&seed) - 6.0;
+	}
+
+	// Reference values of the kernel samples (a subset is enough)
+	int n_check = BENCH_SAMPLES / 16;
+	long double complex * kernel_ref = (long double complex *) malloc( n_check * sizeof(long double complex));
+	assert(kernel_ref != NULL);
+	for( int n = 0; n < n_check; n++ )
+		kernel_ref[n] = ref_W( kernel_Z[n] );
+
+	border_print();
+	center_print("FADDEEVA EVALUATOR BENCHMARK", 79);
+	border_print();
+	printf("%-10s %14s %14s %14s %14s %14s\n", "Evaluator", "Kernel ns/eval", "Core ns/eval",
+	       "Err |z|<6", "Err |z|<100", "Err kernel");
+
+	double sink = 0;
+	int best = -1;
+	double best_time = 0;
+	for( int e = 0; e < FADDEEVA_EVALUATORS; e++ )
+	{
+		double kernel_time = time_evaluator( e, kernel_Z, table, &sink );
+		double core_time = time_evaluator( e, core_Z, table, &sink );
+
+		// Upper half-plane grids: |Re z|, Im z <= 6 and <= 100
+		double core_error = 0;
+		double wide_error = 0;
+		for( int g = 0; g < 2; g++ )
+		{
+			double radius = ( g == 0 ) ? 6.0 : 100.0;
+			double step = ( g == 0 ) ? 0.01 : 0.2;
+			double * error = ( g == 0 ) ? &core_error : &wide_error;
+			for( double y = 0; y <= radius; y += step )
+				for( double x = -radius; x <= radius; x += step )
+				{
+					RSComplex Z = {x, y};
+					double err = rel_error( faddeeva_W( Z, e, table ), ref_W( Z ) );
+					if( err > *error )
+						*error = err;
+				}
+		}
+
+		double kernel_error = 0;
+		for( int n = 0; n < n_check; n++ )
+		{
+			double err = rel_error( faddeeva_W( kernel_Z[n], e, table ), kernel_ref[n] );
+			if( err > kernel_error )
+				kernel_error = err;
+		}
+
+		printf("%-10s %14.2lf %14.2lf %14.3e %14.3e %14.3e\n", names[e], kernel_time, core_time,
+		       core_error, wide_error, kernel_error);
+
+		if( kernel_error <= tolerance && ( best < 0 || kernel_time < best_time ) )
+		{
+			best = e;
+			best_time = kernel_time;
+		}
+	}
+	border_print();
+
+	if( best >= 0 )
+		printf("Fastest evaluator within tolerance %.1e: %s (-F %s)\n", tolerance, names[best], names[best]);
+	else
+		printf("No evaluator is within tolerance %.1e\n", tolerance);
+	// Keeps the timed evaluations from being optimized out
+	if( sink == 0.123456789 )
+		printf("%lf\n", sink);
+
+	free(kernel_Z);
+	free(core_Z);
+	free(kernel_ref);
+	free(table);
+
+	return 0;
+}
@@ -18,15 +18,51 @@ SimulationData initialize_simulation( Input input )
 	SD.n_windows = generate_n_windows( input, &seed );
 	SD.length_n_windows = input.n_nuclides;
 
+	// Poles and windows of all nuclides are stored back to back (CSR), so
+	// nuclides are not padded to the maximum number of poles or windows.
+	SD.pole_offsets = generate_offsets( input, SD.n_poles );
+	SD.length_pole_offsets = input.n_nuclides + 1;
+	SD.window_offsets = generate_offsets( input, SD.n_windows );
+	SD.length_window_offsets = input.n_nuclides + 1;
+
 	// Prepare full resonance grid
 	printf("Generating resonance parameter grid...\n");
-	SD.poles = generate_poles( input, SD.n_poles, &seed, &SD.max_num_poles );
-	SD.length_poles = input.n_nuclides * SD.max_num_poles;
+	SD.poles = generate_poles( input, SD.n_poles, SD.pole_offsets, &seed, &SD.max_num_poles );
+	SD.length_poles = SD.pole_offsets[input.n_nuclides];
+
+	// Prepare structure of arrays copy of the resonance grid
+	if( input.pole_layout == POLES_SOA )
+	{
+		printf("Generating SoA resonance parameter grid...\n");
+		SD.poles_soa = generate_poles_soa( SD.poles, SD.length_poles, &SD.pole_l_values );
+		SD.length_poles_soa = POLE_SOA_COMPONENTS * SD.length_poles;
+		SD.length_pole_l_values = SD.length_poles;
+	}
+	else
+	{
+		SD.poles_soa = NULL;
+		SD.length_poles_soa = 0;
+		SD.pole_l_values = NULL;
+		SD.length_pole_l_values = 0;
+	}
 
 	// Prepare full Window grid
 	printf("Generating window parameter grid...\n");
-	SD.windows = generate_window_params( input, SD.n_windows, SD.n_poles, &seed, &SD.max_num_windows);
-	SD.length_windows = input.n_nuclides * SD.max_num_windows;
+	SD.windows = generate_window_params( input, SD.n_windows, SD.window_offsets, SD.n_poles, &seed, &SD.max_num_windows);
+	SD.length_windows = SD.window_offsets[input.n_nuclides];
+
+	// Prepare window background curve fits
+	if( input.fit_order > 0 )
+	{
+		printf("Generating window background curve fits...\n");
+		SD.curvefit = generate_curvefit( input, SD.length_windows );
+		SD.length_curvefit = SD.length_windows * ( input.fit_order + 1 ) * CURVEFIT_CHANNELS;
+	}
+	else
+	{
+		SD.curvefit = NULL;
+		SD.length_curvefit = 0;
+	}
 
 	// Prepare 0K Resonances
 	printf("Generating 0K l_value data...\n");
@@ -36,9 +72,29 @@ SimulationData initialize_simulation( Input input )
 	return SD;
 }
 
+// Adds "n_samples" samples of the LCG stream starting at "seed", each picking
+// one of "n_bins" bins uniformly, to the histogram R. Every thread samples a
+// contiguous block of the stream (fast forwarded to its first sample) into a
+// private histogram, and the private histograms are summed, so the counts are
+// exactly those of a single sequential pass.
+static void sample_histogram( int * R, int n_bins, long n_samples, uint64_t seed )
+{
+	#pragma omp parallel reduction(+:R[:n_bins])
+	{
+		long n_threads = omp_get_num_threads();
+		long thread = omp_get_thread_num();
+		long first = n_samples * thread / n_threads;
+		long last  = n_samples * (thread + 1) / n_threads;
+
+		uint64_t thread_seed = fast_forward_LCG(seed, first);
+		for( long i = first; i < last; i++ )
+			R[LCG_random_int(&thread_seed) % n_bins]++;
+	}
+}
+
 int * generate_n_poles( Input input, uint64_t * seed )
 {
-	int total_resonances = input.avg_n_poles * input.n_nuclides;
+	long total_resonances = (long) input.avg_n_poles * input.n_nuclides;
 
 	int * R = (int *) malloc( input.n_nuclides * sizeof(int));
 	
@@ -47,8 +103,8 @@ int * generate_n_poles( Input input, uint64_t * seed )
 		R[i] = 1;
 
 	// Sample the rest
-	for( int i = 0; i < total_resonances - input.n_nuclides; i++ )
-		R[LCG_random_int(seed) % input.n_nuclides]++;
+	sample_histogram( R, input.n_nuclides, total_resonances - input.n_nuclides, *seed );
+	*seed = fast_forward_LCG(*seed, total_resonances - input.n_nuclides);
 	
 	/* Debug	
 	for( int i = 0; i < input.n_nuclides; i++ )
@@ -60,7 +116,7 @@ int * generate_n_poles( Input input, uint64_t * seed )
 
 int * generate_n_windows( Input input, uint64_t * seed )
 {
-	int total_resonances = input.avg_n_windows * input.n_nuclides;
+	long total_resonances = (long) input.avg_n_windows * input.n_nuclides;
 
 	int * R = (int *) malloc( input.n_nuclides * sizeof(int));
 	
@@ -69,8 +125,8 @@ int * generate_n_windows( Input input, uint64_t * seed )
 		R[i] = 1;
 
 	// Sample the rest
-	for( int i = 0; i < total_resonances - input.n_nuclides; i++ )
-		R[LCG_random_int(seed) % input.n_nuclides]++;
+	sample_histogram( R, input.n_nuclides, total_resonances - input.n_nuclides, *seed );
+	*seed = fast_forward_LCG(*seed, total_resonances - input.n_nuclides);
 	
 	/* Debug	
 	for( int i = 0; i < input.n_nuclides; i++ )
@@ -80,7 +136,21 @@ int * generate_n_windows( Input input, uint64_t * seed )
 	return R;
 }
 
-Pole * generate_poles( Input input, int * n_poles, uint64_t * seed, int * max_num_poles )
+// Returns the offset of the first item of each nuclide when the items
+// ("counts" per nuclide) of all nuclides are stored back to back. The last
+// entry is the total number of items.
+int * generate_offsets( Input input, int * counts )
+{
+	int * R = (int *) malloc( (input.n_nuclides + 1) * sizeof(int));
+
+	R[0] = 0;
+	for( int i = 0; i < input.n_nuclides; i++ )
+		R[i+1] = R[i] + counts[i];
+
+	return R;
+}
+
+Pole * generate_poles( Input input, int * n_poles, int * pole_offsets, uint64_t * seed, int * max_num_poles )
 {
 	// Pole Scaling Factor -- Used to bias hitting of the fast Faddeeva
 	// region to approximately 99.5% (i.e., only 0.5% of lookups should
@@ -97,42 +167,76 @@ Pole * generate_poles( Input input, int * n_poles, uint64_t * seed, int * max_nu
 	}
 	*max_num_poles = max_poles;
 
-	// Allocating 2D matrix as a 1D contiguous vector
-	Pole * R = (Pole *) malloc( input.n_nuclides * max_poles * sizeof(Pole));
+	// Allocating the poles of all nuclides back to back
+	Pole * R = (Pole *) malloc( pole_offsets[input.n_nuclides] * sizeof(Pole));
 	
-	// fill with data
+	// fill with data. Every pole draws 9 samples from the LCG stream, so each
+	// nuclide fast forwards the stream to its first pole, which produces
+	// exactly the same data as a single sequential pass over all poles.
+	#pragma omp parallel for schedule(dynamic)
 	for( int i = 0; i < input.n_nuclides; i++ )
+	{
+		uint64_t nuclide_seed = fast_forward_LCG(*seed, 9 * (uint64_t) pole_offsets[i]);
 		for( int j = 0; j < n_poles[i]; j++ )
 		{
-			double r = LCG_random_double(seed);
-			double im = LCG_random_double(seed);
+			double r = LCG_random_double(&nuclide_seed);
+			double im = LCG_random_double(&nuclide_seed);
 			RSComplex t1 = {r, im};
-			R[i * max_poles + j].MP_EA = c_mul(f_c,t1);
-			r = LCG_random_double(seed);
-			im = LCG_random_double(seed);
+			R[pole_offsets[i] + j].MP_EA = c_mul(f_c,t1);
+			r = LCG_random_double(&nuclide_seed);
+			im = LCG_random_double(&nuclide_seed);
 			RSComplex t2 = {f*r, im};
-			R[i * max_poles + j].MP_RT = t2;
-			r = LCG_random_double(seed);
-			im = LCG_random_double(seed);
+			R[pole_offsets[i] + j].MP_RT = t2;
+			r = LCG_random_double(&nuclide_seed);
+			im = LCG_random_double(&nuclide_seed);
 			RSComplex t3 = {f*r, im};
-			R[i * max_poles + j].MP_RA = t3;
-			r = LCG_random_double(seed);
-			im = LCG_random_double(seed);
+			R[pole_offsets[i] + j].MP_RA = t3;
+			r = LCG_random_double(&nuclide_seed);
+			im = LCG_random_double(&nuclide_seed);
 			RSComplex t4 = {f*r, im};
-			R[i * max_poles + j].MP_RF = t4;
-			R[i * max_poles + j].l_value = LCG_random_int(seed) % input.numL;
+			R[pole_offsets[i] + j].MP_RF = t4;
+			R[pole_offsets[i] + j].l_value = LCG_random_int(&nuclide_seed) % input.numL;
 		}
+	}
+	*seed = fast_forward_LCG(*seed, 9 * (uint64_t) pole_offsets[input.n_nuclides]);
 	
 	/* Debug
 	for( int i = 0; i < input.n_nuclides; i++ )
 		for( int j = 0; j < n_poles[i]; j++ )
-			printf("R[%d][%d]: Eo = %lf lambda_o = %lf Tn = %lf Tg = %lf Tf = %lf\n", i, j, R[i * max_poles + j].Eo, R[i * max_poles + j].lambda_o, R[i * max_poles + j].Tn, R[i * max_poles + j].Tg, R[i * max_poles + j].Tf);
+			printf("R[%d][%d]: Eo = %lf lambda_o = %lf Tn = %lf Tg = %lf Tf = %lf\n", i, j, R[pole_offsets[i] + j].Eo, R[pole_offsets[i] + j].lambda_o, R[pole_offsets[i] + j].Tn, R[pole_offsets[i] + j].Tg, R[pole_offsets[i] + j].Tf);
 	*/
 
 	return R;
 }
 
-Window * generate_window_params( Input input, int * n_windows, int * n_poles, uint64_t * seed, int * max_num_windows )
+// Copies the resonance grid into the structure of arrays layout: one array
+// per real and imaginary part of each pole parameter (see POLE_EA_R, etc),
+// plus an array of l_values
+double * generate_poles_soa( Pole * poles, unsigned long length_poles, short ** l_values )
+{
+	double * R = (double *) malloc( POLE_SOA_COMPONENTS * length_poles * sizeof(double));
+	short * L = (short *) malloc( length_poles * sizeof(short));
+	assert(R != NULL && L != NULL);
+
+	#pragma omp parallel for
+	for( unsigned long p = 0; p < length_poles; p++ )
+	{
+		R[POLE_EA_R * length_poles + p] = poles[p].MP_EA.r;
+		R[POLE_EA_I * length_poles + p] = poles[p].MP_EA.i;
+		R[POLE_RT_R * length_poles + p] = poles[p].MP_RT.r;
+		R[POLE_RT_I * length_poles + p] = poles[p].MP_RT.i;
+		R[POLE_RA_R * length_poles + p] = poles[p].MP_RA.r;
+		R[POLE_RA_I * length_poles + p] = poles[p].MP_RA.i;
+		R[POLE_RF_R * length_poles + p] = poles[p].MP_RF.r;
+		R[POLE_RF_I * length_poles + p] = poles[p].MP_RF.i;
+		L[p] = poles[p].l_value;
+	}
+
+	*l_values = L;
+	return R;
+}
+
+Window * generate_window_params( Input input, int * n_windows, int * window_offsets, int * n_poles, uint64_t * seed, int * max_num_windows )
 {
 	int max_windows = -1;
 	
@@ -143,32 +247,59 @@ Window * generate_window_params( Input input, int * n_windows, int * n_poles, ui
 	}
 	*max_num_windows = max_windows;
 
-	// Allocating 2D contiguous matrix
-	Window * R = (Window *) malloc( input.n_nuclides * max_windows * sizeof(Window));
+	// Allocating the windows of all nuclides back to back
+	Window * R = (Window *) malloc( window_offsets[input.n_nuclides] * sizeof(Window));
 	
-	// fill with data
+	// fill with data (every window draws 3 samples, see generate_poles)
+	#pragma omp parallel for schedule(dynamic)
 	for( int i = 0; i < input.n_nuclides; i++ )
 	{
+		uint64_t nuclide_seed = fast_forward_LCG(*seed, 3 * (uint64_t) window_offsets[i]);
 		int space = n_poles[i] / n_windows[i];
 		int remainder = n_poles[i] - space * n_windows[i];
 		int ctr = 0;
 		for( int j = 0; j < n_windows[i]; j++ )
 		{
-			R[i * max_windows + j].T = LCG_random_double(seed);
-			R[i * max_windows + j].A = LCG_random_double(seed);
-			R[i * max_windows + j].F = LCG_random_double(seed);
-			R[i * max_windows + j].start = ctr; 
-			R[i * max_windows + j].end = ctr + space - 1;
+			R[window_offsets[i] + j].T = LCG_random_double(&nuclide_seed);
+			R[window_offsets[i] + j].A = LCG_random_double(&nuclide_seed);
+			R[window_offsets[i] + j].F = LCG_random_double(&nuclide_seed);
+			R[window_offsets[i] + j].start = ctr; 
+			R[window_offsets[i] + j].end = ctr + space - 1;
 
 			ctr += space;
 
 			if ( j < remainder )
 			{
 				ctr++;
-				R[i * max_windows + j].end++;
+				R[window_offsets[i] + j].end++;
 			}
 		}
 	}
+	*seed = fast_forward_LCG(*seed, 3 * (uint64_t) window_offsets[input.n_nuclides]);
+
+	return R;
+}
+
+// Samples the background curve fit coefficients of all windows (see
+// calculate_window_background). They are drawn from their own stream, so the
+// rest of the data is the same with or without a curve fit.
+double * generate_curvefit( Input input, unsigned long length_windows )
+{
+	unsigned long length = length_windows * ( input.fit_order + 1 ) * CURVEFIT_CHANNELS;
+	double * R = (double *) malloc( length * sizeof(double));
+	assert(R != NULL);
+
+	#pragma omp parallel
+	{
+		unsigned long n_threads = omp_get_num_threads();
+		unsigned long thread = omp_get_thread_num();
+		unsigned long first = length * thread / n_threads;
+		unsigned long last  = length * (thread + 1) / n_threads;
+
+		uint64_t seed = fast_forward_LCG(CURVEFIT_SEED, first);
+		for( unsigned long i = first; i < last; i++ )
+			R[i] = LCG_random_double(&seed);
+	}
 
 	return R;
 }
@@ -177,9 +308,34 @@ double * generate_pseudo_K0RS( Input input, uint64_t * seed )
 {
 	double * R = (double *) malloc( input.n_nuclides * input.numL * sizeof(double));
 
+	#pragma omp parallel for
 	for( int i = 0; i < input.n_nuclides; i++)
+	{
+		uint64_t nuclide_seed = fast_forward_LCG(*seed, (uint64_t) i * input.numL);
 		for( int j = 0; j < input.numL; j++ )
-			R[i * input.numL + j] = LCG_random_double(seed);
+			R[i * input.numL + j] = LCG_random_double(&nuclide_seed);
+	}
+	*seed = fast_forward_LCG(*seed, (uint64_t) input.n_nuclides * input.numL);
+
+	return R;
+}
+
+// Tabulates w(z) (with the Weideman approximation) on the grid of
+// FADDEEVA_TABLE_NX x FADDEEVA_TABLE_NY points covering -6 <= Re(z) <= 6 and
+// 0 <= Im(z) <= 6, for the table Faddeeva evaluator. Row iy holds
+// Im(z) = iy * FADDEEVA_TABLE_STEP.
+RSComplex * generate_faddeeva_table( void )
+{
+	RSComplex * R = (RSComplex *) malloc( FADDEEVA_TABLE_NX * FADDEEVA_TABLE_NY * sizeof(RSComplex));
+	assert(R != NULL);
+
+	#pragma omp parallel for
+	for( int iy = 0; iy < FADDEEVA_TABLE_NY; iy++ )
+		for( int ix = 0; ix < FADDEEVA_TABLE_NX; ix++ )
+		{
+			RSComplex z = {-FADDEEVA_TABLE_RADIUS + ix * FADDEEVA_TABLE_STEP, iy * FADDEEVA_TABLE_STEP};
+			R[iy * FADDEEVA_TABLE_NX + ix] = weideman_w( z );
+		}
 
 	return R;
 }
@@ -87,6 +87,22 @@ Input read_CLI( int argc, char * argv[] )
 	input.doppler = 1;
 	// defaults to baseline simulation kernel
 	input.kernel_id = 0;
+	// defaults to no dataset cache
+	input.cache_dir = NULL;
+	// defaults to the array of structures pole layout
+	input.pole_layout = POLES_AOS;
+	// defaults to the Abrarov / asymptotic expansion Faddeeva evaluator
+	input.faddeeva = FADDEEVA_DEFAULT;
+	// defaults to all materials at the reference temperature (dopp = 0.5)
+	input.temperature_mode = TEMPERATURE_UNIFORM;
+	input.temperature_list = NULL;
+	// defaults to a background linear in E (no curve fit)
+	input.fit_order = 0;
+	// defaults to mapping the data from the host in every kernel, once
+	input.device_data = DEVICE_DATA_MAP;
+	input.runs = 1;
+	// defaults to no batch lookups
+	input.batch_mats = 0;
 	
 	int default_lookups = 1;
 	int default_particles = 1;
@@ -194,6 +210,111 @@ Input read_CLI( int argc, char * argv[] )
 			else
 				print_CLI_error();
 		}
+		// Pole layout (-L)
+		else if( strcmp(arg, "-L") == 0 )
+		{
+			if( ++i < argc )
+			{
+				if( strcmp(argv[i], "aos") == 0 )
+					input.pole_layout = POLES_AOS;
+				else if( strcmp(argv[i], "soa") == 0 )
+					input.pole_layout = POLES_SOA;
+				else
+					print_CLI_error();
+			}
+			else
+				print_CLI_error();
+		}
+		// Faddeeva evaluator (-F)
+		else if( strcmp(arg, "-F") == 0 )
+		{
+			if( ++i < argc )
+			{
+				if( strcmp(argv[i], "default") == 0 )
+					input.faddeeva = FADDEEVA_DEFAULT;
+				else if( strcmp(argv[i], "fused") == 0 )
+					input.faddeeva = FADDEEVA_FUSED;
+				else if( strcmp(argv[i], "humlicek") == 0 )
+					input.faddeeva = FADDEEVA_HUMLICEK;
+				else if( strcmp(argv[i], "weideman") == 0 )
+					input.faddeeva = FADDEEVA_WEIDEMAN;
+				else if( strcmp(argv[i], "table") == 0 )
+					input.faddeeva = FADDEEVA_TABLE;
+				else
+					print_CLI_error();
+			}
+			else
+				print_CLI_error();
+		}
+		// Material temperatures (-T)
+		else if( strcmp(arg, "-T") == 0 )
+		{
+			if( ++i < argc )
+			{
+				if( strcmp(argv[i], "uniform") == 0 )
+					input.temperature_mode = TEMPERATURE_UNIFORM;
+				else if( strcmp(argv[i], "core") == 0 )
+					input.temperature_mode = TEMPERATURE_CORE;
+				else if( strcmp(argv[i], "sampled") == 0 )
+					input.temperature_mode = TEMPERATURE_SAMPLED;
+				else
+				{
+					input.temperature_mode = TEMPERATURE_LIST;
+					input.temperature_list = argv[i];
+				}
+			}
+			else
+				print_CLI_error();
+		}
+		// Window background curve fit order (-f)
+		else if( strcmp(arg, "-f") == 0 )
+		{
+			if( ++i < argc )
+				input.fit_order = atoi(argv[i]);
+			else
+				print_CLI_error();
+		}
+		// Device data handling (-D)
+		else if( strcmp(arg, "-D") == 0 )
+		{
+			if( ++i < argc )
+			{
+				if( strcmp(argv[i], "map") == 0 )
+					input.device_data = DEVICE_DATA_MAP;
+				else if( strcmp(argv[i], "bcast") == 0 )
+					input.device_data = DEVICE_DATA_BCAST;
+				else if( strcmp(argv[i], "persistent") == 0 )
+					input.device_data = DEVICE_DATA_PERSISTENT;
+				else
+					print_CLI_error();
+			}
+			else
+				print_CLI_error();
+		}
+		// Repeated kernel runs (-R)
+		else if( strcmp(arg, "-R") == 0 )
+		{
+			if( ++i < argc )
+				input.runs = atoi(argv[i]);
+			else
+				print_CLI_error();
+		}
+		// Materials per batch lookup (-M)
+		else if( strcmp(arg, "-M") == 0 )
+		{
+			if( ++i < argc )
+				input.batch_mats = atoi(argv[i]);
+			else
+				print_CLI_error();
+		}
+		// Dataset cache directory (-c)
+		else if( strcmp(arg, "-c") == 0 )
+		{
+			if( ++i < argc )
+				input.cache_dir = argv[i];
+			else
+				print_CLI_error();
+		}
 		else
 			print_CLI_error();
 	}
@@ -220,6 +341,24 @@ Input read_CLI( int argc, char * argv[] )
 	if( input.avg_n_windows < 1 )
 		print_CLI_error();
 	
+	// Validate curve fit order
+	if( input.fit_order < 0 || input.fit_order > MAX_FIT_ORDER )
+		print_CLI_error();
+
+	// Validate runs
+	if( input.runs < 1 )
+		print_CLI_error();
+
+	// Validate pole layout (the optimized kernels only read the AoS layout)
+	if( input.pole_layout == POLES_SOA && input.kernel_id != 0 )
+		print_CLI_error();
+
+	// Validate batch lookups (event based only)
+	if( input.batch_mats < 0 || input.batch_mats > N_MATERIALS )
+		print_CLI_error();
+	if( input.batch_mats > 0 && input.simulation_method != EVENT_BASED )
+		print_CLI_error();
+
 	// Set HM size specific parameters
 	// (defaults to large)
 	if( input.HM == SMALL )
@@ -239,6 +378,15 @@ void print_CLI_error(void)
 	printf("  -P <poles>       Average Number of Poles per Nuclide\n");
 	printf("  -W <poles>       Average Number of Windows per Nuclide\n");
 	printf("  -d               Disables Temperature Dependence (Doppler Broadening)\n");
+	printf("  -k <kernel ID>   Optimized kernel (1: hoisted energy terms, 2: material sorted event lookups)\n");
+	printf("  -L <layout>      Pole layout read by the kernels (aos, soa). Defaults to aos. Kernels 1 and 2 require aos.\n");
+	printf("  -F <evaluator>   Faddeeva function evaluator (default, fused, humlicek, weideman, table)\n");
+	printf("  -T <temps>       Material temperatures (uniform, core, sampled, or 12 comma separated values in K)\n");
+	printf("  -f <order>       Order of the window background curve fit in sqrt(E) (0: linear in E, default)\n");
+	printf("  -D <mode>        Device data handling (map, bcast, persistent). Defaults to map.\n");
+	printf("  -R <runs>        Number of repeated kernel runs\n");
+	printf("  -M <materials>   Event based lookups on the host against this many materials (1-12) each, with and without shared micro XS\n");
+	printf("  -c <cache dir>   Load all data structures from the dataset cache in this directory\n");
 	printf("Default is equivalent to: -s large -l 34 -p 300000 -P 1000 -W 100\n");
 	printf("See readme for full description of default run values\n");
 	exit(4);
@@ -267,6 +415,21 @@ void print_input_summary(Input input)
 	printf("Total Nuclides:              %d\n", input.n_nuclides);
 	printf("Avg Poles per Nuclide:       "); fancy_int(input.avg_n_poles);
 	printf("Avg Windows per Nuclide:     "); fancy_int(input.avg_n_windows);
+	if( input.pole_layout == POLES_SOA )
+		printf("Pole Layout:                 Structure of Arrays\n");
+	else
+		printf("Pole Layout:                 Array of Structures\n");
+	if( input.fit_order > 0 )
+		printf("Window Background:           Curve Fit (order %d)\n", input.fit_order);
+	else
+		printf("Window Background:           Linear\n");
+	if( input.doppler == 1 )
+	{
+		const char * evaluators[FADDEEVA_EVALUATORS] = {"Default (Abrarov + QUICK_2)", "Fused Abrarov + QUICK_2", "Humlicek w4", "Weideman (N = 32)", "Table + QUICK_2"};
+		printf("Faddeeva Evaluator:          %s\n", evaluators[input.faddeeva]);
+		const char * temperatures[4] = {"Uniform", "PWR Core", "Sampled", "From Command Line"};
+		printf("Material Temperatures:       %s\n", temperatures[input.temperature_mode]);
+	}
 
 	int lookups = input.lookups;
 	if( input.simulation_method == HISTORY_BASED )
@@ -276,7 +439,15 @@ void print_input_summary(Input input)
 		lookups *= input.particles;
 	}
 	printf("Total XS Lookups:            "); fancy_int(lookups);
+	const char * device_data[3] = {"Mapped by Every Kernel", "Device Broadcast per Run", "Device Broadcast, Persistent"};
+	printf("Device Data:                 %s\n", device_data[input.device_data]);
+	if( input.runs > 1 )
+		printf("Kernel Runs:                 %d\n", input.runs);
+	if( input.batch_mats > 0 )
+		printf("Batch Lookups:               %d Materials per Energy (host)\n", input.batch_mats);
 	printf("Est. Memory Usage (MB):      %.1lf\n", mem / 1024.0 / 1024.0);
+	if( input.cache_dir != NULL )
+		printf("Dataset Cache:               %s\n", input.cache_dir);
 }
 
 int validate_and_print_results(Input input, double runtime, unsigned long vhash)
@@ -288,6 +459,7 @@ int validate_and_print_results(Input input, double runtime, unsigned long vhash)
 		lookups = input.lookups*input.particles;
 	else
 		lookups = input.lookups;
+	lookups *= input.runs;
 	printf("Lookups:               "); fancy_int(lookups);
 	printf("Lookups/s:             "); fancy_int((double) lookups / (runtime));
 
@@ -326,6 +498,245 @@ int validate_and_print_results(Input input, double runtime, unsigned long vhash)
 		else
 			printf("Verification checksum: %lu (WARNING - INAVALID CHECKSUM!)\n", vhash);
 	}
+	if( input.doppler == 1 && input.faddeeva != FADDEEVA_DEFAULT && input.faddeeva != FADDEEVA_FUSED )
+		printf("NOTE - Checksums are only defined for the default and fused Faddeeva evaluators.\n");
+	if( input.doppler == 1 && input.temperature_mode != TEMPERATURE_UNIFORM )
+		printf("NOTE - Checksums are only defined for uniform material temperatures.\n");
+	if( input.fit_order > 0 )
+		printf("NOTE - Checksums are only defined for the linear window background.\n");
 
 	return is_invalid;
 }
+
+// Pointers to, and element sizes of, all arrays stored in a dataset cache file
+static void binary_arrays( SimulationData * SD, void *** ptr, size_t * size, unsigned long ** length )
+{
+	ptr[0] = (void **) &SD->n_poles;     size[0] = sizeof(int);    length[0] = &SD->length_n_poles;
+	ptr[1] = (void **) &SD->n_windows;   size[1] = sizeof(int);    length[1] = &SD->length_n_windows;
+	ptr[2] = (void **) &SD->poles;       size[2] = sizeof(Pole);   length[2] = &SD->length_poles;
+	ptr[3] = (void **) &SD->windows;     size[3] = sizeof(Window); length[3] = &SD->length_windows;
+	ptr[4] = (void **) &SD->pseudo_K0RS; size[4] = sizeof(double); length[4] = &SD->length_pseudo_K0RS;
+	ptr[5] = (void **) &SD->num_nucs;    size[5] = sizeof(int);    length[5] = &SD->length_num_nucs;
+	ptr[6] = (void **) &SD->mats;        size[6] = sizeof(int);    length[6] = &SD->length_mats;
+	ptr[7] = (void **) &SD->concs;       size[7] = sizeof(double); length[7] = &SD->length_concs;
+	ptr[8] = (void **) &SD->poles_soa;     size[8] = sizeof(double); length[8] = &SD->length_poles_soa;
+	ptr[9] = (void **) &SD->pole_l_values; size[9] = sizeof(short);  length[9] = &SD->length_pole_l_values;
+	ptr[10] = (void **) &SD->pole_offsets;   size[10] = sizeof(int); length[10] = &SD->length_pole_offsets;
+	ptr[11] = (void **) &SD->window_offsets; size[11] = sizeof(int); length[11] = &SD->length_window_offsets;
+	ptr[12] = (void **) &SD->curvefit;       size[12] = sizeof(double); length[12] = &SD->length_curvefit;
+}
+
+// Checksum of "n" bytes of data. The data is hashed in 1 MB blocks in
+// parallel (FNV-1a over 64-bit words), and the block hashes are then
+// combined in order, so the result does not depend on the number of threads.
+static uint64_t binary_checksum( char * data, unsigned long n )
+{
+	const uint64_t prime = 1099511628211ULL;
+	const unsigned long block = 1 << 20;
+	long n_blocks = ( n + block - 1 ) / block;
+	uint64_t * block_hash = (uint64_t *) malloc( (n_blocks + 1) * sizeof(uint64_t));
+	assert(block_hash != NULL);
+
+	#pragma omp parallel for schedule(dynamic)
+	for( long b = 0; b < n_blocks; b++ )
+	{
+		char * p = data + b * block;
+		unsigned long len = ( b == n_blocks - 1 ) ? n - b * block : block;
+		uint64_t hash = 14695981039346656037ULL;
+		unsigned long w = 0;
+		for( ; w + 8 <= len; w += 8 )
+		{
+			uint64_t word;
+			memcpy(&word, p + w, sizeof(uint64_t));
+			hash = ( hash ^ word ) * prime;
+		}
+		for( ; w < len; w++ )
+			hash = ( hash ^ (unsigned char) p[w] ) * prime;
+		block_hash[b] = hash;
+	}
+
+	uint64_t hash = 14695981039346656037ULL;
+	for( long b = 0; b < n_blocks; b++ )
+		hash = ( hash ^ block_hash[b] ) * prime;
+
+	free(block_hash);
+	return hash;
+}
+
+// Writes all data structures to a dataset cache file. Returns 0 on success.
+static int binary_save( Input input, SimulationData SD, const char * fname )
+{
+	void ** ptr[BINARY_FILE_ARRAYS];
+	size_t size[BINARY_FILE_ARRAYS];
+	unsigned long * length[BINARY_FILE_ARRAYS];
+	binary_arrays( &SD, ptr, size, length );
+
+	BinaryHeader H;
+	memset(&H, 0, sizeof(BinaryHeader));
+	strcpy(H.magic, BINARY_FILE_MAGIC);
+	H.version         = BINARY_FILE_VERSION;
+	H.n_nuclides      = input.n_nuclides;
+	H.avg_n_poles     = input.avg_n_poles;
+	H.avg_n_windows   = input.avg_n_windows;
+	H.numL            = input.numL;
+	H.max_num_nucs    = SD.max_num_nucs;
+	H.max_num_poles   = SD.max_num_poles;
+	H.max_num_windows = SD.max_num_windows;
+
+	unsigned long offset = sizeof(BinaryHeader);
+	for( int a = 0; a < BINARY_FILE_ARRAYS; a++ )
+	{
+		H.length[a] = *length[a];
+		H.offset[a] = ( offset + BINARY_FILE_ALIGNMENT - 1 ) / BINARY_FILE_ALIGNMENT * BINARY_FILE_ALIGNMENT;
+		offset = H.offset[a] + H.length[a] * size[a];
+	}
+	H.file_size = offset;
+
+	// The file is assembled in a (zero filled) shared mapping, so that the
+	// checksum can be taken over exactly the bytes that end up on disk.
+	int fd = open(fname, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if( fd < 0 )
+		return 1;
+	if( ftruncate(fd, H.file_size) != 0 )
+	{
+		close(fd);
+		return 1;
+	}
+	char * base = (char *) mmap(NULL, H.file_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if( base == MAP_FAILED )
+		return 1;
+
+	for( int a = 0; a < BINARY_FILE_ARRAYS; a++ )
+		memcpy(base + H.offset[a], *ptr[a], H.length[a] * size[a]);
+
+	H.checksum = binary_checksum(base + sizeof(BinaryHeader), H.file_size - sizeof(BinaryHeader));
+	memcpy(base, &H, sizeof(BinaryHeader));
+
+	int err = msync(base, H.file_size, MS_SYNC);
+	munmap(base, H.file_size);
+
+	return err != 0;
+}
+
+// Maps a dataset cache file and points all arrays of SD directly into the
+// mapping. Fails if the file was not written by this version of RSBench for
+// the same problem, or if its data does not match the stored checksum.
+// Returns 0 on success, otherwise prints the reason and returns nonzero.
+static int binary_load( Input input, const char * fname, SimulationData * SD )
+{
+	memset(SD, 0, sizeof(SimulationData));
+
+	int fd = open(fname, O_RDONLY);
+	if( fd < 0 )
+	{
+		printf("Dataset not found in cache.\n");
+		return 1;
+	}
+
+	BinaryHeader H;
+	struct stat st;
+	if( read(fd, &H, sizeof(BinaryHeader)) != sizeof(BinaryHeader) || fstat(fd, &st) != 0 ||
+	    strncmp(H.magic, BINARY_FILE_MAGIC, sizeof(H.magic)) != 0 || H.version != BINARY_FILE_VERSION )
+	{
+		printf("%s is not a version %d RSBench dataset file.\n", fname, BINARY_FILE_VERSION);
+		close(fd);
+		return 1;
+	}
+
+	if( H.n_nuclides != input.n_nuclides || H.avg_n_poles != input.avg_n_poles ||
+	    H.avg_n_windows != input.avg_n_windows || H.numL != input.numL || (size_t) st.st_size != H.file_size )
+	{
+		printf("%s does not match the requested problem.\n", fname);
+		close(fd);
+		return 1;
+	}
+
+	char * base = (char *) mmap(NULL, H.file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if( base == MAP_FAILED )
+	{
+		printf("Could not map %s.\n", fname);
+		return 1;
+	}
+
+	if( binary_checksum(base + sizeof(BinaryHeader), H.file_size - sizeof(BinaryHeader)) != H.checksum )
+	{
+		printf("%s is corrupted (checksum mismatch).\n", fname);
+		munmap(base, H.file_size);
+		return 1;
+	}
+
+	void ** ptr[BINARY_FILE_ARRAYS];
+	size_t size[BINARY_FILE_ARRAYS];
+	unsigned long * length[BINARY_FILE_ARRAYS];
+	binary_arrays( SD, ptr, size, length );
+
+	for( int a = 0; a < BINARY_FILE_ARRAYS; a++ )
+	{
+		*ptr[a] = base + H.offset[a];
+		*length[a] = H.length[a];
+	}
+	SD->max_num_nucs    = H.max_num_nucs;
+	SD->max_num_poles   = H.max_num_poles;
+	SD->max_num_windows = H.max_num_windows;
+
+	return 0;
+}
+
+// Loads all data structures from the dataset cache. Datasets are stored as
+// files named after a hash of the inputs that determine them, so that any
+// number of runs of the same problem share one file (and XSBench and RSBench
+// can share one cache directory). On a miss (or if the cached file fails
+// validation) the data is initialized as usual and written to the cache.
+// Files are written under a temporary name and then renamed, so that
+// concurrent runs never see a partially written dataset.
+SimulationData binary_cache_load( Input input )
+{
+	SimulationData SD;
+
+	struct{
+		char magic[8];
+		long version;
+		long n_nuclides;
+		long avg_n_poles;
+		long avg_n_windows;
+		long numL;
+		long pole_layout;
+		long fit_order;
+	} key;
+	memset(&key, 0, sizeof(key));
+	strcpy(key.magic, BINARY_FILE_MAGIC);
+	key.version       = BINARY_FILE_VERSION;
+	key.n_nuclides    = input.n_nuclides;
+	key.avg_n_poles   = input.avg_n_poles;
+	key.avg_n_windows = input.avg_n_windows;
+	key.numL          = input.numL;
+	key.pole_layout   = input.pole_layout;
+	key.fit_order     = input.fit_order;
+
+	char fname[4096];
+	snprintf(fname, sizeof(fname), "%s/rsbench-%016llx.dat", input.cache_dir,
+	         (unsigned long long) binary_checksum((char *) &key, sizeof(key)));
+
+	printf("Looking up dataset cache file %s...\n", fname);
+	if( binary_load(input, fname, &SD) == 0 )
+	{
+		printf("Loaded all data structures from the dataset cache.\n");
+		return SD;
+	}
+
+	SD = initialize_simulation( input );
+
+	char tmp_fname[4096 + 32];
+	snprintf(tmp_fname, sizeof(tmp_fname), "%s.tmp.%d", fname, (int) getpid());
+	printf("Adding all data structures to the dataset cache...\n");
+	if( ( mkdir(input.cache_dir, 0755) != 0 && access(input.cache_dir, W_OK) != 0 ) ||
+	    binary_save(input, SD, tmp_fname) != 0 || rename(tmp_fname, fname) != 0 )
+	{
+		printf("WARNING - could not write dataset cache file %s!\n", fname);
+		unlink(tmp_fname);
+	}
+
+	return SD;
+}
@@ -29,7 +29,38 @@ int main(int argc, char * argv[])
 	
 	start = get_time();
 	
-	SimulationData SD = initialize_simulation( input );
+	// In cache mode, the data is loaded from the dataset cache, or
+	// initialized and added to the cache if it is not there yet.
+	SimulationData SD;
+	if( input.cache_dir != NULL )
+		SD = binary_cache_load( input );
+	else
+		SD = initialize_simulation( input );
+
+	// The Faddeeva table does not depend on the problem, so it is not
+	// stored in the dataset cache
+	if( input.doppler == 1 && input.faddeeva == FADDEEVA_TABLE )
+	{
+		printf("Generating Faddeeva function table...\n");
+		SD.faddeeva_table = generate_faddeeva_table();
+		SD.length_faddeeva_table = FADDEEVA_TABLE_NX * FADDEEVA_TABLE_NY;
+	}
+	else
+	{
+		SD.faddeeva_table = NULL;
+		SD.length_faddeeva_table = 0;
+	}
+
+	// Neither are the material temperatures
+	SD.temperatures = load_temperatures( input, SD.length_num_nucs );
+	SD.length_temperatures = SD.length_num_nucs;
+	SD.dopp = load_dopp( SD.temperatures, SD.length_num_nucs );
+	SD.length_dopp = SD.length_num_nucs;
+
+	// Nor is the nuclide to material incidence (used by batch lookups), which
+	// is derived from the materials
+	SD.nuc_mat_offsets = load_nuc_mats( input, SD.num_nucs, SD.mats, SD.concs, SD.max_num_nucs, &SD.nuc_mat_mats, &SD.nuc_mat_concs, &SD.length_nuc_mat_entries );
+	SD.length_nuc_mat_offsets = input.n_nuclides + 1;
 
 	stop = get_time();
 
@@ -47,23 +78,53 @@ int main(int argc, char * argv[])
 	// Run Simulation
 	start = get_time();
 
+	// With device broadcast, the data is put on the devices before each run,
+	// or only once if it is persistent (the time is part of the runtime)
+	DeviceData DD;
+	if( input.device_data == DEVICE_DATA_PERSISTENT )
+		DD = device_data_broadcast( SD );
+
 	// Run simulation
-	if( input.simulation_method == EVENT_BASED )
+	for( int run = 0; run < input.runs; run++ )
 	{
-		if( input.kernel_id == 0 )
-			run_event_based_simulation(input, SD, &vhash );
-		else
+		if( input.device_data == DEVICE_DATA_BCAST )
+			DD = device_data_broadcast( SD );
+
+		if( input.simulation_method == EVENT_BASED )
 		{
-			printf("Error: No kernel ID %d found!\n", input.kernel_id);
-			exit(1);
+			if( input.batch_mats > 0 )
+				run_batch_simulation(input, SD, &vhash );
+			else if( input.kernel_id == 0 )
+				run_event_based_simulation(input, SD, &vhash );
+			else if( input.kernel_id == 1 )
+				run_event_based_simulation_optimization_1(input, SD, &vhash );
+			else if( input.kernel_id == 2 )
+				run_event_based_simulation_optimization_2(input, SD, &vhash );
+			else
+			{
+				printf("Error: No kernel ID %d found!\n", input.kernel_id);
+				exit(1);
+			}
 		}
-	}
-	else if( input.simulation_method == HISTORY_BASED )
-	{
-		printf("History-based simulation not implemented in OpenMP offload code. Instead,\nuse the event-based method with \"-m event\" argument.\n");
-		exit(1);
+		else if( input.simulation_method == HISTORY_BASED )
+		{
+			// Kernel 1 is the baseline with hoisted energy terms
+			if( input.kernel_id == 0 || input.kernel_id == 1 )
+				run_history_based_simulation(input, SD, &vhash );
+			else
+			{
+				printf("Error: No kernel ID %d found!\n", input.kernel_id);
+				exit(1);
+			}
+		}
+
+		if( input.device_data == DEVICE_DATA_BCAST )
+			device_data_release( SD, DD );
 	}
 
+	if( input.device_data == DEVICE_DATA_PERSISTENT )
+		device_data_release( SD, DD );
+
 	stop = get_time();
 
 	// Final hash step
@@ -80,6 +141,12 @@ int main(int argc, char * argv[])
 
 	int is_invalid = validate_and_print_results(input, stop-start, vhash);
 
+	if( input.doppler == 1 )
+	{
+		border_print();
+		print_faddeeva_branch_stats( SD );
+	}
+
 	border_print();
 
 	// return is_invalid;
@@ -121,3 +121,110 @@ double * load_concs( int * num_nucs, uint64_t * seed, int max_num_nucs )
 	return concs;
 }
 
+
+// Temperature (K) of each material, as selected by -T
+double * load_temperatures( Input input, int n_mats )
+{
+	double * T = (double *) malloc( n_mats * sizeof(double) );
+	assert(T != NULL);
+
+	if( input.temperature_mode == TEMPERATURE_CORE )
+	{
+		// Typical PWR temperatures: hot fuel, cladding, and structures
+		// above the core at the hot leg temperature, and structures below
+		// the core at the cold leg temperature
+		double core[12] = {
+			900.0, // fuel
+			600.0, // cladding
+			565.0, // cold, borated water
+			600.0, // hot, borated water
+			565.0, // RPV
+			565.0, // Lower, radial reflector
+			600.0, // Upper reflector / top plate
+			565.0, // bottom plate
+			565.0, // bottom nozzle
+			600.0, // top nozzle
+			600.0, // top of fuel assemblies
+			565.0  // bottom of fuel assemblies
+		};
+		memcpy( T, core, n_mats * sizeof(double) );
+	}
+	else if( input.temperature_mode == TEMPERATURE_SAMPLED )
+	{
+		uint64_t seed = TEMPERATURE_SEED;
+		for( int m = 0; m < n_mats; m++ )
+			T[m] = MIN_SAMPLED_TEMPERATURE + ( MAX_SAMPLED_TEMPERATURE - MIN_SAMPLED_TEMPERATURE ) * LCG_random_double(&seed);
+	}
+	else if( input.temperature_mode == TEMPERATURE_LIST )
+	{
+		char * p = input.temperature_list;
+		for( int m = 0; m < n_mats; m++ )
+		{
+			char * end;
+			T[m] = strtod( p, &end );
+			if( end == p || T[m] <= 0 || ( *end != ',' && m < n_mats - 1 ) || ( *end != '\0' && m == n_mats - 1 ) )
+			{
+				printf("Error: -T needs %d positive, comma separated temperatures (one per material)!\n", n_mats);
+				exit(1);
+			}
+			p = end + 1;
+		}
+	}
+	else
+	{
+		for( int m = 0; m < n_mats; m++ )
+			T[m] = REFERENCE_TEMPERATURE;
+	}
+
+	return T;
+}
+
+// Doppler broadening parameter of each material. The Doppler width grows
+// with sqrt(T), so Z = (E - pole) * dopp shrinks, and more poles fall in the
+// |Z| < 6 region of the Faddeeva function, as the temperature rises.
+double * load_dopp( double * temperatures, int n_mats )
+{
+	double * dopp = (double *) malloc( n_mats * sizeof(double) );
+	assert(dopp != NULL);
+
+	for( int m = 0; m < n_mats; m++ )
+		dopp[m] = 0.5 * sqrt( REFERENCE_TEMPERATURE / temperatures[m] );
+
+	return dopp;
+}
+
+// Inverts the material compositions into a nuclide to material incidence
+// structure, in CSR form: the materials containing nuclide n are
+// nuc_mat_mats[nuc_mat_offsets[n] .. nuc_mat_offsets[n+1]-1] (in increasing
+// order), with the concentration of the nuclide in each of them in
+// nuc_mat_concs. Returns nuc_mat_offsets (of length n_nuclides + 1).
+int * load_nuc_mats( Input input, int * num_nucs, int * mats, double * concs, int max_num_nucs, int ** nuc_mat_mats, double ** nuc_mat_concs, unsigned long * length_entries )
+{
+	int n_nuclides = input.n_nuclides;
+	int * offsets = (int *) calloc( n_nuclides + 1, sizeof(int) );
+	assert(offsets != NULL);
+
+	// Count the materials of each nuclide, then turn the counts into offsets
+	for( int m = 0; m < N_MATERIALS; m++ )
+		for( int i = 0; i < num_nucs[m]; i++ )
+			offsets[mats[m * max_num_nucs + i] + 1]++;
+	for( int n = 0; n < n_nuclides; n++ )
+		offsets[n + 1] += offsets[n];
+	*length_entries = offsets[n_nuclides];
+
+	*nuc_mat_mats  = (int *) malloc( *length_entries * sizeof(int) );
+	*nuc_mat_concs = (double *) malloc( *length_entries * sizeof(double) );
+	int * next = (int *) malloc( n_nuclides * sizeof(int) );
+	assert(*nuc_mat_mats != NULL && *nuc_mat_concs != NULL && next != NULL);
+	memcpy( next, offsets, n_nuclides * sizeof(int) );
+	for( int m = 0; m < N_MATERIALS; m++ )
+		for( int i = 0; i < num_nucs[m]; i++ )
+		{
+			int e = next[mats[m * max_num_nucs + i]]++;
+			(*nuc_mat_mats)[e]  = m;
+			(*nuc_mat_concs)[e] = concs[m * max_num_nucs + i];
+		}
+	free(next);
+
+	return offsets;
+}
@@ -7,6 +7,11 @@
 #include<float.h>
 #include<omp.h>
 #include<assert.h>
+#include<unistd.h>
+#include<fcntl.h>
+#include<sys/mman.h>
+#include<sys/stat.h>
+#include "rscomplex.h"
 
 #define OPENMP
 
@@ -21,10 +26,84 @@ typedef enum __hm{SMALL, LARGE, XL, XXL} HM_size;
 #define STARTING_SEED 1070
 #define INITIALIZATION_SEED 42
 
-typedef struct{
-	double r;
-	double i;
-} RSComplex;
+// Material temperatures (-T). A material at temperature T is Doppler
+// broadened with dopp = 0.5 sqrt(REFERENCE_TEMPERATURE / T), so the uniform
+// default keeps dopp = 0.5 for every material.
+#define TEMPERATURE_UNIFORM 0  // All materials at REFERENCE_TEMPERATURE
+#define TEMPERATURE_CORE 1     // Typical PWR core temperatures (hot fuel, cooler water)
+#define TEMPERATURE_SAMPLED 2  // Sampled uniformly in [MIN, MAX]_SAMPLED_TEMPERATURE
+#define TEMPERATURE_LIST 3     // Read from the command line
+#define REFERENCE_TEMPERATURE 293.6
+#define MIN_SAMPLED_TEMPERATURE 293.6
+#define MAX_SAMPLED_TEMPERATURE 1200.0
+#define TEMPERATURE_SEED 7
+
+// Lookups sampled to count the Faddeeva branches taken per material
+#define BRANCH_STATS_LOOKUPS 100000
+
+// Materials in the H-M benchmark (see material.c), which is also the largest
+// batch of materials per lookup (-M)
+#define N_MATERIALS 12
+
+// Lookups compared between batch and per-material lookups (-M)
+#define BATCH_CHECK_LOOKUPS 100000
+
+// Lookups per batch of the material sorted event kernel (-k 2)
+#define SORT_BATCH_LOOKUPS 4194304
+
+// Pole layouts. The structure of arrays (SoA) layout is kept alongside the
+// regular array of Pole structures.
+#define POLES_AOS 0
+#define POLES_SOA 1
+
+// Components of the SoA pole layout. Each is an array of length_poles doubles
+// in poles_soa, indexed like poles.
+#define POLE_EA_R 0
+#define POLE_EA_I 1
+#define POLE_RT_R 2
+#define POLE_RT_I 3
+#define POLE_RA_R 4
+#define POLE_RA_I 5
+#define POLE_RF_R 6
+#define POLE_RF_I 7
+#define POLE_SOA_COMPONENTS 8
+
+// Faddeeva function evaluators (-F)
+#define FADDEEVA_DEFAULT 0   // Abrarov for |Z| < 6, QUICK_2 asymptotic expansion otherwise
+#define FADDEEVA_FUSED 1     // Same, with the Abrarov terms that do not depend on n hoisted
+#define FADDEEVA_HUMLICEK 2  // Humlicek w4
+#define FADDEEVA_WEIDEMAN 3  // Weideman rational approximation (N = 32)
+#define FADDEEVA_TABLE 4     // Interpolated table for |Z| < 6, QUICK_2 otherwise
+#define FADDEEVA_EVALUATORS 5
+
+// Grid of the Faddeeva table: w(z) for -6 <= Re(z) <= 6 and 0 <= Im(z) <= 6
+#define FADDEEVA_TABLE_RADIUS 6.0
+#define FADDEEVA_TABLE_STEP 0.025
+#define FADDEEVA_TABLE_NX 481
+#define FADDEEVA_TABLE_NY 241
+
+// Window background curve fit (-f). Each window stores fit_order + 1
+// coefficients per channel, with the channels of each coefficient
+// interleaved: curvefit[(window * (fit_order + 1) + k) * CURVEFIT_CHANNELS + channel].
+#define MAX_FIT_ORDER 16
+#define CURVEFIT_T 0
+#define CURVEFIT_A 1
+#define CURVEFIT_F 2
+#define CURVEFIT_CHANNELS 3
+#define CURVEFIT_SEED 13
+
+// Device data handling (-D). See device.c.
+#define DEVICE_DATA_MAP 0         // Every kernel maps its arrays from the host
+#define DEVICE_DATA_BCAST 1       // Broadcast from device to device before every run
+#define DEVICE_DATA_PERSISTENT 2  // Broadcast once, and kept resident across runs
+#define DEVICE_DATA_ARRAYS 15
+
+// Dataset cache file format. Bump the version whenever the layout of the file
+// or of the stored data structures changes.
+#define BINARY_FILE_MAGIC "RSBENCH"
+#define BINARY_FILE_VERSION 4
+#define BINARY_FILE_ALIGNMENT 4096
+#define BINARY_FILE_ARRAYS 13
 
 typedef struct{
 	int nthreads;
@@ -38,6 +117,15 @@ typedef struct{
 	int particles;
 	int simulation_method;
 	int kernel_id;
+	char * cache_dir;
+	int pole_layout;
+	int faddeeva;
+	int temperature_mode;
+	char * temperature_list; // Comma separated temperatures (TEMPERATURE_LIST)
+	int fit_order;           // Order of the window background curve fit (0: linear background)
+	int device_data;
+	int runs;                // Number of repeated kernel runs
+	int batch_mats;          // Materials per lookup in batch lookup mode (0: off)
 } Input;
 
 typedef struct{
@@ -61,10 +149,26 @@ typedef struct{
 	unsigned long length_n_poles;
 	int * n_windows;
 	unsigned long length_n_windows;
+	int * pole_offsets;                  // First pole of each nuclide (CSR)
+	unsigned long length_pole_offsets;
+	int * window_offsets;                // First window of each nuclide (CSR)
+	unsigned long length_window_offsets;
 	Pole * poles;
 	unsigned long length_poles;
+	double * poles_soa;
+	unsigned long length_poles_soa;
+	short * pole_l_values;
+	unsigned long length_pole_l_values;
 	Window * windows;
 	unsigned long length_windows;
+	double * curvefit;                   // Background curve fit of each window (only with fit_order > 0)
+	unsigned long length_curvefit;
+	RSComplex * faddeeva_table;          // Only with FADDEEVA_TABLE (not cached)
+	unsigned long length_faddeeva_table;
+	double * temperatures;               // Temperature (K) of each material (not cached)
+	unsigned long length_temperatures;
+	double * dopp;                       // Doppler broadening parameter of each material (not cached)
+	unsigned long length_dopp;
 	double * pseudo_K0RS;
 	unsigned long length_pseudo_K0RS;
 	int * num_nucs;
@@ -73,6 +177,11 @@ typedef struct{
 	unsigned long length_mats;
 	double * concs;
 	unsigned long length_concs;
+	int * nuc_mat_offsets;               // Materials containing each nuclide (CSR, not cached)
+	unsigned long length_nuc_mat_offsets;
+	int * nuc_mat_mats;
+	double * nuc_mat_concs;
+	unsigned long length_nuc_mat_entries;
 	int max_num_nucs;
 	int max_num_poles;
 	int max_num_windows;
@@ -82,6 +191,35 @@ typedef struct{
 	unsigned long length_mat_samples;
 } SimulationData;
 
+// Device copies of the arrays of a SimulationData (see device.c). The copy of
+// array a on device K is device_ptr[a * num_devices + K].
+typedef struct{
+	int num_devices;
+	void ** device_ptr;
+	size_t bytes;         // Bytes per device
+} DeviceData;
+
+// Header of a dataset cache file. It records the inputs that determine the
+// data structures, the length and location of each array (in the order
+// listed in binary_arrays), and a checksum of everything after the header.
+// Every array starts on a BINARY_FILE_ALIGNMENT boundary so that the file
+// can be memory mapped and the arrays used in place.
+typedef struct{
+	char magic[8];
+	int version;
+	int n_nuclides;
+	int avg_n_poles;
+	int avg_n_windows;
+	int numL;
+	int max_num_nucs;
+	int max_num_poles;
+	int max_num_windows;
+	unsigned long length[BINARY_FILE_ARRAYS];
+	unsigned long offset[BINARY_FILE_ARRAYS];
+	unsigned long file_size;
+	uint64_t checksum;
+} BinaryHeader;
+
 // io.c
 void logo(int version);
 void center_print(const char *s, int width);
@@ -91,31 +229,61 @@ Input read_CLI( int argc, char * argv[] );
 void print_CLI_error(void);
 void print_input_summary(Input input);
 int validate_and_print_results(Input input, double runtime, unsigned long vhash);
+SimulationData binary_cache_load( Input input );
 
 // init.c
 SimulationData initialize_simulation( Input input );
 int * generate_n_poles( Input input,  uint64_t * seed );
 int * generate_n_windows( Input input ,  uint64_t * seed);
-Pole * generate_poles( Input input, int * n_poles, uint64_t * seed, int * max_num_poles );
-Window * generate_window_params( Input input, int * n_windows, int * n_poles, uint64_t * seed, int * max_num_windows );
+int * generate_offsets( Input input, int * counts );
+Pole * generate_poles( Input input, int * n_poles, int * pole_offsets, uint64_t * seed, int * max_num_poles );
+double * generate_poles_soa( Pole * poles, unsigned long length_poles, short ** l_values );
+Window * generate_window_params( Input input, int * n_windows, int * window_offsets, int * n_poles, uint64_t * seed, int * max_num_windows );
 double * generate_pseudo_K0RS( Input input, uint64_t * seed );
+double * generate_curvefit( Input input, unsigned long length_windows );
+RSComplex * generate_faddeeva_table( void );
 
 // material.c
 int * load_num_nucs(Input input);
 int * load_mats( Input input, int * num_nucs, int * max_num_nucs, unsigned long * length_mats );
 double * load_concs( int * num_nucs, uint64_t * seed, int max_num_nucs );
 SimulationData get_materials(Input input, uint64_t * seed);
+double * load_temperatures( Input input, int n_mats );
+double * load_dopp( double * temperatures, int n_mats );
+int * load_nuc_mats( Input input, int * num_nucs, int * mats, double * concs, int max_num_nucs, int ** nuc_mat_mats, double ** nuc_mat_concs, unsigned long * length_entries );
+
+// stats.c
+void print_faddeeva_branch_stats( SimulationData SD );
+
+// batch.c
+void run_batch_simulation( Input input, SimulationData SD, unsigned long * vhash_result );
+
+// device.c
+DeviceData device_data_broadcast( SimulationData SD );
+void device_data_release( SimulationData SD, DeviceData DD );
 
 // utils.c
 size_t get_mem_estimate( Input input );
-RSComplex fast_cexp( RSComplex z );
 double get_time(void);
 
 // xs_kernel.c
 RSComplex fast_nuclear_W( RSComplex Z );
-void calculate_macro_xs( double * macro_xs, int mat, double E, Input input, int * num_nucs, int * mats, int max_num_nucs, double * concs, int * n_windows, double * pseudo_K0Rs, Window * windows, Pole * poles, int max_num_windows, int max_num_poles ) ;
-void calculate_micro_xs( double * micro_xs, int nuc, double E, Input input, int * n_windows, double * pseudo_K0RS, Window * windows, Pole * poles, int max_num_windows, int max_num_poles);
-void calculate_micro_xs_doppler( double * micro_xs, int nuc, double E, Input input, int * n_windows, double * pseudo_K0RS, Window * windows, Pole * poles, int max_num_windows, int max_num_poles );
+RSComplex quick_2_W( RSComplex Z );
+RSComplex fused_nuclear_W( RSComplex Z );
+RSComplex humlicek_w4( RSComplex Z );
+RSComplex weideman_w( RSComplex Z );
+RSComplex table_nuclear_W( RSComplex Z, RSComplex * table );
+RSComplex faddeeva_W( RSComplex Z, int evaluator, RSComplex * table );
+RSComplexVec quick_2_W_vec( RSComplexVec Z );
+RSComplexVec weideman_w_vec( RSComplexVec Z );
+RSComplexVec humlicek_w4_region1_vec( RSComplexVec Z );
+RSComplexVec faddeeva_W_vec( RSComplexVec Z, int evaluator, RSComplex * table );
+void calculate_window_background( double * background, double E, double sqrt_E, double inv_E, Window w, int window_idx, int fit_order, double * curvefit );
+void calculate_macro_xs( double * macro_xs, int mat, double E, Input input, int * num_nucs, int * mats, int max_num_nucs, double * concs, int * n_windows, double * pseudo_K0Rs, Window * windows, Pole * poles, int * window_offsets, int * pole_offsets, double * curvefit, double * poles_soa, short * pole_l_values, RSComplex * faddeeva_table, double * dopp ) ;
+void calculate_micro_xs( double * micro_xs, int nuc, double E, Input input, int * n_windows, double * pseudo_K0RS, Window * windows, Pole * poles, int * window_offsets, int * pole_offsets, double * curvefit);
+void calculate_micro_xs_doppler( double * micro_xs, int nuc, double E, Input input, int * n_windows, double * pseudo_K0RS, Window * windows, Pole * poles, int * window_offsets, int * pole_offsets, double * curvefit, RSComplex * faddeeva_table, double dopp );
+void calculate_micro_xs_soa( double * micro_xs, int nuc, double E, Input input, int * n_windows, double * pseudo_K0RS, Window * windows, double * poles_soa, short * pole_l_values, int * window_offsets, int * pole_offsets, double * curvefit );
+void calculate_micro_xs_doppler_soa( double * micro_xs, int nuc, double E, Input input, int * n_windows, double * pseudo_K0RS, Window * windows, double * poles_soa, short * pole_l_values, int * window_offsets, int * pole_offsets, double * curvefit, RSComplex * faddeeva_table, double dopp );
 
 // simulation.c
 void run_event_based_simulation(Input input, SimulationData data, unsigned long * vhash_result );
@@ -124,16 +292,14 @@ double LCG_random_double(uint64_t * seed);
 uint64_t LCG_random_int(uint64_t * seed);
 uint64_t fast_forward_LCG(uint64_t seed, uint64_t n);
 void run_event_based_simulation_optimization_1(Input in, SimulationData SD, unsigned long * vhash_result );
+void run_event_based_simulation_optimization_2(Input in, SimulationData SD, unsigned long * vhash_result );
+void calculate_sig_T_hoisted( int nuc, double sqrt_E, Input input, double * pseudo_K0RS, RSComplex * sigTfactors );
+void calculate_micro_xs_hoisted( double * micro_xs, int nuc, double E, double sqrt_E, double inv_E, Input input, int * n_windows, double * pseudo_K0RS, Window * windows, Pole * poles, int * window_offsets, int * pole_offsets, double * curvefit );
+void calculate_micro_xs_doppler_hoisted( double * micro_xs, int nuc, double E, double sqrt_E, Input input, int * n_windows, double * pseudo_K0RS, Window * windows, Pole * poles, int * window_offsets, int * pole_offsets, double * curvefit, RSComplex * faddeeva_table, double dopp );
+void calculate_macro_xs_hoisted( double * macro_xs, int mat, double E, Input input, int * num_nucs, int * mats, int max_num_nucs, double * concs, int * n_windows, double * pseudo_K0Rs, Window * windows, Pole * poles, int * window_offsets, int * pole_offsets, double * curvefit, RSComplex * faddeeva_table, double * dopp );
 int pick_mat( uint64_t * seed );
 void calculate_sig_T( int nuc, double E, Input input, double * pseudo_K0RS, RSComplex * sigTfactors );
 
-// rscomplex.c
-RSComplex c_add( RSComplex A, RSComplex B);
-RSComplex c_sub( RSComplex A, RSComplex B);
-RSComplex c_mul( RSComplex A, RSComplex B);
-RSComplex c_div( RSComplex A, RSComplex B);
-double c_abs( RSComplex A);
-
 // papi.c
 void counter_init( int *eventset, int *num_papi_events );
 void counter_stop( int * eventset, int num_papi_events );
@@ -0,0 +1,242 @@
+#ifndef RSCOMPLEX_H
+#define RSCOMPLEX_H
+
+#include<math.h>
+
+////////////////////////////////////////////////////////////////////////////////////
+// COMPLEX ARITHMETIC
+////////////////////////////////////////////////////////////////////////////////////
+// Header-only complex arithmetic for RSBench, in two forms:
+//
+//   RSComplex:    one complex number, passed by value (c_add, c_mul, ...).
+//                 These are plain inline functions, usable on the host and in
+//                 target regions.
+//   RSComplexVec: RSCOMPLEX_SIMD_WIDTH complex numbers, with the real and
+//                 imaginary parts in separate SIMD registers (cv_add, cv_mul,
+//                 ...). The width is 8 with AVX-512, 4 with AVX2, and 1 (the
+//                 scalar fallback, which is also used in device code)
+//                 otherwise. Define RSCOMPLEX_NO_SIMD to force the fallback.
+//
+// Both forms use the same formulas, but the results of a vector lane and of
+// the scalar operation can still differ in the last bits: the compiler may
+// contract a multiply and an add into an FMA in one form and not in the other
+// (GCC contracts by default; -ffp-contract=off prevents it), and loops that
+// accumulate in vector lanes (e.g., the SoA pole loops) sum in a different
+// order than the scalar loop. The cross sections then differ by relative
+// amounts of order 1e-15, which does not change the verification hash of any
+// of the tested problems.
+//
+// The vector forms are used by the SoA pole loops (-L soa) and the Faddeeva
+// evaluators they call (see faddeeva_W_vec). The AoS pole loops stay scalar:
+// a Pole holds all the parameters of one pole, so loading the same parameter
+// of RSCOMPLEX_SIMD_WIDTH poles would need a gather per parameter, and the
+// AoS loops are the ones the device kernels run, where the width is 1 anyway.
+////////////////////////////////////////////////////////////////////////////////////
+
+typedef struct{
+	double r;
+	double i;
+} RSComplex;
+
+#pragma omp declare target
+
+static inline RSComplex c_add( RSComplex A, RSComplex B)
+{
+	RSComplex C;
+	C.r = A.r + B.r;
+	C.i = A.i + B.i;
+	return C;
+}
+
+static inline RSComplex c_sub( RSComplex A, RSComplex B)
+{
+	RSComplex C;
+	C.r = A.r - B.r;
+	C.i = A.i - B.i;
+	return C;
+}
+
+static inline RSComplex c_mul( RSComplex A, RSComplex B)
+{
+	double a = A.r;
+	double b = A.i;
+	double c = B.r;
+	double d = B.i;
+	RSComplex C;
+	C.r = (a*c) - (b*d);
+	C.i = (a*d) + (b*c);
+	return C;
+}
+
+static inline RSComplex c_div( RSComplex A, RSComplex B)
+{
+	double a = A.r;
+	double b = A.i;
+	double c = B.r;
+	double d = B.i;
+	RSComplex C;
+	double denom = c*c + d*d;
+	C.r = ( (a*c) + (b*d) ) / denom;
+	C.i = ( (b*c) - (a*d) ) / denom;
+	return C;
+}
+
+static inline double c_abs( RSComplex A)
+{
+	return sqrt(A.r*A.r + A.i * A.i);
+}
+
+// Fast (but inaccurate) exponential function
+// Written By "ACMer":
+// https://codingforspeed.com/using-faster-exponential-approximation/
+// We use our own to avoid small differences in compiler specific
+// exp() intrinsic implementations that make it difficult to verify
+// if the code is working correctly or not.
+static inline double fast_exp(double x)
+{
+  x = 1.0 + x * 0.000244140625;
+  x *= x; x *= x; x *= x; x *= x;
+  x *= x; x *= x; x *= x; x *= x;
+  x *= x; x *= x; x *= x; x *= x;
+  return x;
+}
+
+// Implementation based on:
+// z = x + iy
+// cexp(z) = e^x * (cos(y) + i * sin(y))
+static inline RSComplex fast_cexp( RSComplex z )
+{
+	double x = z.r;
+	double y = z.i;
+
+	// For consistency across architectures, we
+	// will use our own exponetial implementation
+	//double t1 = exp(x);
+	double t1 = fast_exp(x);
+	double t2 = cos(y);
+	double t3 = sin(y);
+	RSComplex t4 = {t2, t3};
+	RSComplex t5 = {t1, 0};
+	RSComplex result = c_mul(t5, (t4));
+	return result;
+}
+
+#pragma omp end declare target
+
+// SIMD registers of doubles (rs_vd) and their operations
+#if !defined(RSCOMPLEX_NO_SIMD) && !defined(__NVPTX__) && !defined(__AMDGCN__) && !defined(__SPIR__) && defined(__AVX512F__)
+
+#include<immintrin.h>
+#define RSCOMPLEX_SIMD_WIDTH 8
+typedef __m512d rs_vd;
+static inline rs_vd rs_load( const double * p )      { return _mm512_loadu_pd(p); }
+static inline void  rs_store( double * p, rs_vd a )  { _mm512_storeu_pd(p, a); }
+static inline rs_vd rs_set1( double a )              { return _mm512_set1_pd(a); }
+static inline rs_vd rs_add( rs_vd a, rs_vd b )       { return _mm512_add_pd(a, b); }
+static inline rs_vd rs_sub( rs_vd a, rs_vd b )       { return _mm512_sub_pd(a, b); }
+static inline rs_vd rs_mul( rs_vd a, rs_vd b )       { return _mm512_mul_pd(a, b); }
+static inline rs_vd rs_div( rs_vd a, rs_vd b )       { return _mm512_div_pd(a, b); }
+static inline rs_vd rs_sqrt( rs_vd a )               { return _mm512_sqrt_pd(a); }
+static inline double rs_sum( rs_vd a )               { return _mm512_reduce_add_pd(a); }
+
+#elif !defined(RSCOMPLEX_NO_SIMD) && !defined(__NVPTX__) && !defined(__AMDGCN__) && !defined(__SPIR__) && defined(__AVX2__)
+
+#include<immintrin.h>
+#define RSCOMPLEX_SIMD_WIDTH 4
+typedef __m256d rs_vd;
+static inline rs_vd rs_load( const double * p )      { return _mm256_loadu_pd(p); }
+static inline void  rs_store( double * p, rs_vd a )  { _mm256_storeu_pd(p, a); }
+static inline rs_vd rs_set1( double a )              { return _mm256_set1_pd(a); }
+static inline rs_vd rs_add( rs_vd a, rs_vd b )       { return _mm256_add_pd(a, b); }
+static inline rs_vd rs_sub( rs_vd a, rs_vd b )       { return _mm256_sub_pd(a, b); }
+static inline rs_vd rs_mul( rs_vd a, rs_vd b )       { return _mm256_mul_pd(a, b); }
+static inline rs_vd rs_div( rs_vd a, rs_vd b )       { return _mm256_div_pd(a, b); }
+static inline rs_vd rs_sqrt( rs_vd a )               { return _mm256_sqrt_pd(a); }
+static inline double rs_sum( rs_vd a )
+{
+	__m128d s = _mm_add_pd(_mm256_castpd256_pd128(a), _mm256_extractf128_pd(a, 1));
+	return _mm_cvtsd_f64(_mm_add_sd(s, _mm_unpackhi_pd(s, s)));
+}
+
+#else
+
+#define RSCOMPLEX_SIMD_WIDTH 1
+typedef double rs_vd;
+#pragma omp declare target
+static inline rs_vd rs_load( const double * p )      { return *p; }
+static inline void  rs_store( double * p, rs_vd a )  { *p = a; }
+static inline rs_vd rs_set1( double a )              { return a; }
+static inline rs_vd rs_add( rs_vd a, rs_vd b )       { return a + b; }
+static inline rs_vd rs_sub( rs_vd a, rs_vd b )       { return a - b; }
+static inline rs_vd rs_mul( rs_vd a, rs_vd b )       { return a * b; }
+static inline rs_vd rs_div( rs_vd a, rs_vd b )       { return a / b; }
+static inline rs_vd rs_sqrt( rs_vd a )               { return sqrt(a); }
+static inline double rs_sum( rs_vd a )               { return a; }
+#pragma omp end declare target
+
+#endif
+
+typedef struct{
+	rs_vd r;
+	rs_vd i;
+} RSComplexVec;
+
+#if RSCOMPLEX_SIMD_WIDTH == 1
+#pragma omp declare target
+#endif
+
+// Loads / stores RSCOMPLEX_SIMD_WIDTH complex numbers from / to separate
+// arrays of real and imaginary parts
+static inline RSComplexVec cv_load( const double * r, const double * i )
+{
+	RSComplexVec C = {rs_load(r), rs_load(i)};
+	return C;
+}
+
+static inline void cv_store( double * r, double * i, RSComplexVec A )
+{
+	rs_store(r, A.r);
+	rs_store(i, A.i);
+}
+
+// All lanes set to A
+static inline RSComplexVec cv_set1( RSComplex A )
+{
+	RSComplexVec C = {rs_set1(A.r), rs_set1(A.i)};
+	return C;
+}
+
+static inline RSComplexVec cv_add( RSComplexVec A, RSComplexVec B )
+{
+	RSComplexVec C = {rs_add(A.r, B.r), rs_add(A.i, B.i)};
+	return C;
+}
+
+static inline RSComplexVec cv_sub( RSComplexVec A, RSComplexVec B )
+{
+	RSComplexVec C = {rs_sub(A.r, B.r), rs_sub(A.i, B.i)};
+	return C;
+}
+
+static inline RSComplexVec cv_mul( RSComplexVec A, RSComplexVec B )
+{
+	RSComplexVec C;
+	C.r = rs_sub(rs_mul(A.r, B.r), rs_mul(A.i, B.i));
+	C.i = rs_add(rs_mul(A.r, B.i), rs_mul(A.i, B.r));
+	return C;
+}
+
+static inline RSComplexVec cv_div( RSComplexVec A, RSComplexVec B )
+{
+	rs_vd denom = rs_add(rs_mul(B.r, B.r), rs_mul(B.i, B.i));
+	RSComplexVec C;
+	C.r = rs_div(rs_add(rs_mul(A.r, B.r), rs_mul(A.i, B.i)), denom);
+	C.i = rs_div(rs_sub(rs_mul(A.i, B.r), rs_mul(A.r, B.i)), denom);
+	return C;
+}
+
+#if RSCOMPLEX_SIMD_WIDTH == 1
+#pragma omp end declare target
+#endif
+
+#endif
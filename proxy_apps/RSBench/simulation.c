@@ -24,20 +24,28 @@ void run_event_based_simulation(Input input, SimulationData data, unsigned long
 
 	printf("Num Devices: %d\nChunk Size: %d\n", num_devices, chunk);
 
+	// Only the pole layout the kernel reads is mapped
+	unsigned long length_poles_aos = ( input.pole_layout == POLES_SOA ) ? 0 : data.length_poles;
+
 	#pragma omp parallel for num_threads(num_devices)
 	for (int K = 0; K < num_devices; K++) {
 		#pragma omp target teams distribute parallel for \
 				map(to:data.n_poles[:data.length_n_poles]) \
 				map(to:data.n_windows[:data.length_n_windows]) \
-				map(to:data.poles[:data.length_poles]) \
+				map(to:data.poles[:length_poles_aos]) \
+				map(to:data.poles_soa[:data.length_poles_soa]) \
+				map(to:data.pole_l_values[:data.length_pole_l_values]) \
 				map(to:data.windows[:data.length_windows]) \
+				map(to:data.curvefit[:data.length_curvefit]) \
 				map(to:data.pseudo_K0RS[:data.length_pseudo_K0RS]) \
 				map(to:data.num_nucs[:data.length_num_nucs]) \
 				map(to:data.mats[:data.length_mats]) \
 				map(to:data.concs[:data.length_concs]) \
 				map(to:data.max_num_nucs) \
-				map(to:data.max_num_poles) \
-				map(to:data.max_num_windows) \
+				map(to:data.pole_offsets[:data.length_pole_offsets]) \
+				map(to:data.window_offsets[:data.length_window_offsets]) \
+				map(to:data.faddeeva_table[:data.length_faddeeva_table]) \
+				map(to:data.dopp[:data.length_dopp]) \
 		        device(K)
 		for( unsigned long i = K * chunk; i < K * chunk + ((K == num_devices-1) ? chunk + input.lookups%num_devices : chunk); i++ )
 		{
@@ -66,8 +74,13 @@ void run_event_based_simulation(Input input, SimulationData data, unsigned long
 				data.pseudo_K0RS,
 				data.windows,
 				data.poles,
-				data.max_num_windows,
-				data.max_num_poles
+				data.window_offsets,
+				data.pole_offsets,
+				data.curvefit,
+				data.poles_soa,
+				data.pole_l_values,
+				data.faddeeva_table,
+				data.dopp
 			);
 
 			// For verification, and to prevent the compiler from optimizing
@@ -102,7 +115,147 @@ void run_event_based_simulation(Input input, SimulationData data, unsigned long
 	*vhash_result = validation_hash;
 }
 
-void calculate_macro_xs( double * macro_xs, int mat, double E, Input input, int * num_nucs, int * mats, int max_num_nucs, double * concs, int * n_windows, double * pseudo_K0Rs, Window * windows, Pole * poles, int max_num_windows, int max_num_poles ) 
+void run_history_based_simulation(Input input, SimulationData data, unsigned long * vhash_result )
+{
+	printf("Beginning baseline history based simulation on device...\n");
+
+	// Each particle is handled by a single thread, which performs all of its
+	// lookups in sequence, as the energy and material of each lookup depend
+	// on the results of the previous one. Particles are split
+	// between the devices like lookups are in the event based simulation.
+	// If no devices are available, the target region is run on the host
+	// (i.e., the initial device) instead.
+	int num_devices = omp_get_num_devices();
+	int offloaded_to_device = ( num_devices > 0 );
+	if( !offloaded_to_device )
+		num_devices = 1;
+	unsigned long chunk = input.particles/num_devices;
+
+	printf("Num Devices: %d\nChunk Size: %lu\n", offloaded_to_device ? num_devices : 0, chunk);
+
+	unsigned long long validation_hash = 0;
+
+	// Only the pole layout the kernel reads is mapped
+	unsigned long length_poles_aos = ( input.pole_layout == POLES_SOA ) ? 0 : data.length_poles;
+
+	#pragma omp parallel for num_threads(num_devices) reduction(+:validation_hash)
+	for (int K = 0; K < num_devices; K++) {
+		int device = offloaded_to_device ? K : omp_get_initial_device();
+		unsigned long first = K * chunk;
+		unsigned long last  = first + ((K == num_devices-1) ? chunk + input.particles%num_devices : chunk);
+		unsigned long long validation_hash_k = 0;
+
+		#pragma omp target teams distribute parallel for reduction(+:validation_hash_k) \
+				map(to:data.n_poles[:data.length_n_poles]) \
+				map(to:data.n_windows[:data.length_n_windows]) \
+				map(to:data.poles[:length_poles_aos]) \
+				map(to:data.poles_soa[:data.length_poles_soa]) \
+				map(to:data.pole_l_values[:data.length_pole_l_values]) \
+				map(to:data.windows[:data.length_windows]) \
+				map(to:data.curvefit[:data.length_curvefit]) \
+				map(to:data.pseudo_K0RS[:data.length_pseudo_K0RS]) \
+				map(to:data.num_nucs[:data.length_num_nucs]) \
+				map(to:data.mats[:data.length_mats]) \
+				map(to:data.concs[:data.length_concs]) \
+				map(to:data.max_num_nucs) \
+				map(to:data.pole_offsets[:data.length_pole_offsets]) \
+				map(to:data.window_offsets[:data.length_window_offsets]) \
+				map(to:data.faddeeva_table[:data.length_faddeeva_table]) \
+				map(to:data.dopp[:data.length_dopp]) \
+				map(tofrom:validation_hash_k) \
+		        device(device)
+		for( unsigned long p = first; p < last; p++ )
+		{
+			// Set the initial seed value
+			uint64_t seed = STARTING_SEED;	
+
+			// Forward seed to particle index (we need 2 samples per lookup, and
+			// leave room for up to 4 extra samples per lookup skipped below)
+			seed = fast_forward_LCG(seed, p * input.lookups * 2 * 4);
+
+			// Randomly pick an energy and material for the particle
+			double E = LCG_random_double(&seed);
+			int mat  = pick_mat(&seed);
+
+			for( unsigned long i = 0; i < input.lookups; i++ )
+			{
+				double macro_xs[4] = {0};
+
+				// Kernel 1 is the baseline with hoisted energy terms
+				// (see run_event_based_simulation_optimization_1)
+				if( input.kernel_id == 1 )
+					calculate_macro_xs_hoisted( macro_xs, mat, E, input, data.num_nucs, data.mats, data.max_num_nucs,
+					                            data.concs, data.n_windows, data.pseudo_K0RS, data.windows, data.poles,
+					                            data.window_offsets, data.pole_offsets, data.curvefit, data.faddeeva_table, data.dopp );
+				else
+					calculate_macro_xs(
+						macro_xs,
+						mat,
+						E,
+						input,
+						data.num_nucs,
+						data.mats,
+						data.max_num_nucs,
+						data.concs,
+						data.n_windows,
+						data.pseudo_K0RS,
+						data.windows,
+						data.poles,
+						data.window_offsets,
+						data.pole_offsets,
+						data.curvefit,
+						data.poles_soa,
+						data.pole_l_values,
+						data.faddeeva_table,
+						data.dopp
+					);
+
+				// For verification, and to prevent the compiler from optimizing
+				// all work out, we interrogate the returned macro_xs_vector array
+				// to find its maximum value index, then increment the verification
+				// value by that index.
+				double max = -DBL_MAX;
+				int max_idx = 0;
+				for(int x = 0; x < 4; x++ )
+				{
+					if( macro_xs[x] > max )
+					{
+						max = macro_xs[x];
+						max_idx = x;
+					}
+				}
+				validation_hash_k += max_idx+1;
+
+				// Randomly pick next energy and material for the particle.
+				// Also incorporates results from the macro_xs lookup to
+				// enforce a loop dependency. In a real MC app, this dependency
+				// is expressed in terms of branching physics sampling, whereas
+				// here we are just artificially enforcing it by altering the seed.
+				uint64_t n_forward = 0;
+				for( int x = 0; x < 4; x++ )
+					if( macro_xs[x] > 1.0 )
+						n_forward++;
+				if( n_forward > 0 )
+					seed = fast_forward_LCG(seed, n_forward);
+
+				E   = LCG_random_double(&seed);
+				mat = pick_mat(&seed);
+			}
+		}
+
+		validation_hash += validation_hash_k;
+	}
+
+	// Print if kernel actually ran on the device
+	if( offloaded_to_device )
+		printf( "Kernel ran accelerator device.\n" );
+	else
+		printf( "NOTE - Kernel ran on the host!\n" );
+
+	*vhash_result = validation_hash;
+}
+
+void calculate_macro_xs( double * macro_xs, int mat, double E, Input input, int * num_nucs, int * mats, int max_num_nucs, double * concs, int * n_windows, double * pseudo_K0Rs, Window * windows, Pole * poles, int * window_offsets, int * pole_offsets, double * curvefit, double * poles_soa, short * pole_l_values, RSComplex * faddeeva_table, double * dopp ) 
 {
 	// zero out macro vector
 	for( int i = 0; i < 4; i++ )
@@ -114,10 +267,17 @@ void calculate_macro_xs( double * macro_xs, int mat, double E, Input input, int
 		double micro_xs[4];
 		int nuc = mats[mat * max_num_nucs + i];
 
-		if( input.doppler == 1 )
-			calculate_micro_xs_doppler( micro_xs, nuc, E, input, n_windows, pseudo_K0Rs, windows, poles, max_num_windows, max_num_poles);
+		if( input.pole_layout == POLES_SOA )
+		{
+			if( input.doppler == 1 )
+				calculate_micro_xs_doppler_soa( micro_xs, nuc, E, input, n_windows, pseudo_K0Rs, windows, poles_soa, pole_l_values, window_offsets, pole_offsets, curvefit, faddeeva_table, dopp[mat]);
+			else
+				calculate_micro_xs_soa( micro_xs, nuc, E, input, n_windows, pseudo_K0Rs, windows, poles_soa, pole_l_values, window_offsets, pole_offsets, curvefit);
+		}
+		else if( input.doppler == 1 )
+			calculate_micro_xs_doppler( micro_xs, nuc, E, input, n_windows, pseudo_K0Rs, windows, poles, window_offsets, pole_offsets, curvefit, faddeeva_table, dopp[mat]);
 		else
-			calculate_micro_xs( micro_xs, nuc, E, input, n_windows, pseudo_K0Rs, windows, poles, max_num_windows, max_num_poles);
+			calculate_micro_xs( micro_xs, nuc, E, input, n_windows, pseudo_K0Rs, windows, poles, window_offsets, pole_offsets, curvefit);
 
 		for( int j = 0; j < 4; j++ )
 		{
@@ -138,7 +298,7 @@ void calculate_macro_xs( double * macro_xs, int mat, double E, Input input, int
 }
 
 // No Temperature dependence (i.e., 0K evaluation)
-void calculate_micro_xs( double * micro_xs, int nuc, double E, Input input, int * n_windows, double * pseudo_K0RS, Window * windows, Pole * poles, int max_num_windows, int max_num_poles)
+void calculate_micro_xs( double * micro_xs, int nuc, double E, Input input, int * n_windows, double * pseudo_K0RS, Window * windows, Pole * poles, int * window_offsets, int * pole_offsets, double * curvefit)
 {
 	// MicroScopic XS's to Calculate
 	double sigT;
@@ -157,17 +317,19 @@ void calculate_micro_xs( double * micro_xs, int nuc, double E, Input input, int
 	calculate_sig_T(nuc, E, input, pseudo_K0RS, sigTfactors );
 
 	// Calculate contributions from window "background" (i.e., poles outside window (pre-calculated)
-	Window w = windows[nuc * max_num_windows + window];
-	sigT = E * w.T;
-	sigA = E * w.A;
-	sigF = E * w.F;
+	Window w = windows[window_offsets[nuc] + window];
+	double background[3];
+	calculate_window_background( background, E, sqrt(E), 1.0 / E, w, window_offsets[nuc] + window, input.fit_order, curvefit );
+	sigT = background[0];
+	sigA = background[1];
+	sigF = background[2];
 
 	// Loop over Poles within window, add contributions
 	for( int i = w.start; i < w.end; i++ )
 	{
 		RSComplex PSIIKI;
 		RSComplex CDUM;
-		Pole pole = poles[nuc * max_num_poles + i];
+		Pole pole = poles[pole_offsets[nuc] + i];
 		RSComplex t1 = {0, 1};
 		RSComplex t2 = {sqrt(E), 0 };
 		PSIIKI = c_div( t1 , c_sub(pole.MP_EA,t2) );
@@ -188,8 +350,9 @@ void calculate_micro_xs( double * micro_xs, int nuc, double E, Input input, int
 
 // Temperature Dependent Variation of Kernel
 // (This involves using the Complex Faddeeva function to
-// Doppler broaden the poles within the window)
-void calculate_micro_xs_doppler( double * micro_xs, int nuc, double E, Input input, int * n_windows, double * pseudo_K0RS, Window * windows, Pole * poles, int max_num_windows, int max_num_poles )
+// Doppler broaden the poles within the window). dopp is the
+// broadening parameter of the material (see load_dopp).
+void calculate_micro_xs_doppler( double * micro_xs, int nuc, double E, Input input, int * n_windows, double * pseudo_K0RS, Window * windows, Pole * poles, int * window_offsets, int * pole_offsets, double * curvefit, RSComplex * faddeeva_table, double dopp )
 {
 	// MicroScopic XS's to Calculate
 	double sigT;
@@ -208,17 +371,17 @@ void calculate_micro_xs_doppler( double * micro_xs, int nuc, double E, Input inp
 	calculate_sig_T(nuc, E, input, pseudo_K0RS, sigTfactors );
 
 	// Calculate contributions from window "background" (i.e., poles outside window (pre-calculated)
-	Window w = windows[nuc * max_num_windows + window];
-	sigT = E * w.T;
-	sigA = E * w.A;
-	sigF = E * w.F;
-
-	double dopp = 0.5;
+	Window w = windows[window_offsets[nuc] + window];
+	double background[3];
+	calculate_window_background( background, E, sqrt(E), 1.0 / E, w, window_offsets[nuc] + window, input.fit_order, curvefit );
+	sigT = background[0];
+	sigA = background[1];
+	sigF = background[2];
 
 	// Loop over Poles within window, add contributions
 	for( int i = w.start; i < w.end; i++ )
 	{
-		Pole pole = poles[nuc * max_num_poles + i];
+		Pole pole = poles[pole_offsets[nuc] + i];
 
 		// Prep Z
 		RSComplex E_c = {E, 0};
@@ -226,7 +389,7 @@ void calculate_micro_xs_doppler( double * micro_xs, int nuc, double E, Input inp
 		RSComplex Z = c_mul(c_sub(E_c, pole.MP_EA), dopp_c);
 
 		// Evaluate Fadeeva Function
-		RSComplex faddeeva = fast_nuclear_W( Z );
+		RSComplex faddeeva = faddeeva_W( Z, input.faddeeva, faddeeva_table );
 
 		// Update W
 		sigT += (c_mul( pole.MP_RT, c_mul(faddeeva, sigTfactors[pole.l_value]) )).r;
@@ -242,6 +405,243 @@ void calculate_micro_xs_doppler( double * micro_xs, int nuc, double E, Input inp
 	micro_xs[3] = sigE;
 }
 
+// Variant of calculate_micro_xs that reads the SoA pole layout. The pole
+// parameters of consecutive poles are contiguous, so the pole loop can be
+// vectorized across poles.
+void calculate_micro_xs_soa( double * micro_xs, int nuc, double E, Input input, int * n_windows, double * pseudo_K0RS, Window * windows, double * poles_soa, short * pole_l_values, int * window_offsets, int * pole_offsets, double * curvefit )
+{
+	// MicroScopic XS's to Calculate
+	double sigT;
+	double sigA;
+	double sigF;
+	double sigE;
+
+	// Calculate Window Index
+	double spacing = 1.0 / n_windows[nuc];
+	int window = (int) ( E / spacing );
+	if( window == n_windows[nuc] )
+		window--;
+
+	// Calculate sigTfactors
+	RSComplex sigTfactors[4]; // Of length input.numL, which is always 4
+	calculate_sig_T(nuc, E, input, pseudo_K0RS, sigTfactors );
+
+	// Calculate contributions from window "background" (i.e., poles outside window (pre-calculated)
+	Window w = windows[window_offsets[nuc] + window];
+	double background[3];
+	calculate_window_background( background, E, sqrt(E), 1.0 / E, w, window_offsets[nuc] + window, input.fit_order, curvefit );
+	sigT = background[0];
+	sigA = background[1];
+	sigF = background[2];
+
+	// Pole parameter arrays of this nuclide
+	unsigned long stride = pole_offsets[input.n_nuclides];
+	double * pole_base = poles_soa + pole_offsets[nuc];
+	double * EA_r = pole_base + POLE_EA_R * stride;
+	double * EA_i = pole_base + POLE_EA_I * stride;
+	double * RT_r = pole_base + POLE_RT_R * stride;
+	double * RT_i = pole_base + POLE_RT_I * stride;
+	double * RA_r = pole_base + POLE_RA_R * stride;
+	double * RA_i = pole_base + POLE_RA_I * stride;
+	double * RF_r = pole_base + POLE_RF_R * stride;
+	double * RF_i = pole_base + POLE_RF_I * stride;
+	short * l_value = pole_l_values + pole_offsets[nuc];
+	double sqrt_E = sqrt(E);
+	RSComplex t1 = {0, 1};
+	RSComplex t2 = {sqrt_E, 0 };
+	RSComplex E_c = {E, 0};
+
+	// Loop over Poles within window, add contributions. The poles are taken
+	// RSCOMPLEX_SIMD_WIDTH at a time, with the same complex arithmetic as the
+	// scalar loop (see rscomplex.h), and the remaining poles one at a time.
+	RSComplexVec t1_v = cv_set1(t1);
+	RSComplexVec t2_v = cv_set1(t2);
+	RSComplexVec E_v = cv_set1(E_c);
+	rs_vd sigT_v = rs_set1(0.0);
+	rs_vd sigA_v = rs_set1(0.0);
+	rs_vd sigF_v = rs_set1(0.0);
+	int i = w.start;
+	for( ; i + RSCOMPLEX_SIMD_WIDTH <= w.end; i += RSCOMPLEX_SIMD_WIDTH )
+	{
+		RSComplexVec MP_EA = cv_load(EA_r + i, EA_i + i);
+		RSComplexVec MP_RT = cv_load(RT_r + i, RT_i + i);
+		RSComplexVec MP_RA = cv_load(RA_r + i, RA_i + i);
+		RSComplexVec MP_RF = cv_load(RF_r + i, RF_i + i);
+		double f_r[RSCOMPLEX_SIMD_WIDTH];
+		double f_i[RSCOMPLEX_SIMD_WIDTH];
+		for( int k = 0; k < RSCOMPLEX_SIMD_WIDTH; k++ )
+		{
+			f_r[k] = sigTfactors[l_value[i+k]].r;
+			f_i[k] = sigTfactors[l_value[i+k]].i;
+		}
+		RSComplexVec PSIIKI = cv_div( t1_v , cv_sub(MP_EA,t2_v) );
+		RSComplexVec CDUM = cv_div(PSIIKI, E_v);
+		sigT_v = rs_add(sigT_v, (cv_mul(MP_RT, cv_mul(CDUM, cv_load(f_r, f_i))) ).r);
+		sigA_v = rs_add(sigA_v, (cv_mul( MP_RA, CDUM)).r);
+		sigF_v = rs_add(sigF_v, (cv_mul(MP_RF, CDUM)).r);
+	}
+	sigT += rs_sum(sigT_v);
+	sigA += rs_sum(sigA_v);
+	sigF += rs_sum(sigF_v);
+	for( ; i < w.end; i++ )
+	{
+		RSComplex PSIIKI;
+		RSComplex CDUM;
+		RSComplex MP_EA = {EA_r[i], EA_i[i]};
+		RSComplex MP_RT = {RT_r[i], RT_i[i]};
+		RSComplex MP_RA = {RA_r[i], RA_i[i]};
+		RSComplex MP_RF = {RF_r[i], RF_i[i]};
+		PSIIKI = c_div( t1 , c_sub(MP_EA,t2) );
+		CDUM = c_div(PSIIKI, E_c);
+		sigT += (c_mul(MP_RT, c_mul(CDUM, sigTfactors[l_value[i]])) ).r;
+		sigA += (c_mul( MP_RA, CDUM)).r;
+		sigF += (c_mul(MP_RF, CDUM)).r;
+	}
+
+	sigE = sigT - sigA;
+
+	micro_xs[0] = sigT;
+	micro_xs[1] = sigA;
+	micro_xs[2] = sigF;
+	micro_xs[3] = sigE;
+}
+
+// Variant of calculate_micro_xs_doppler that reads the SoA pole layout
+void calculate_micro_xs_doppler_soa( double * micro_xs, int nuc, double E, Input input, int * n_windows, double * pseudo_K0RS, Window * windows, double * poles_soa, short * pole_l_values, int * window_offsets, int * pole_offsets, double * curvefit, RSComplex * faddeeva_table, double dopp )
+{
+	// MicroScopic XS's to Calculate
+	double sigT;
+	double sigA;
+	double sigF;
+	double sigE;
+
+	// Calculate Window Index
+	double spacing = 1.0 / n_windows[nuc];
+	int window = (int) ( E / spacing );
+	if( window == n_windows[nuc] )
+		window--;
+
+	// Calculate sigTfactors
+	RSComplex sigTfactors[4]; // Of length input.numL, which is always 4
+	calculate_sig_T(nuc, E, input, pseudo_K0RS, sigTfactors );
+
+	// Calculate contributions from window "background" (i.e., poles outside window (pre-calculated)
+	Window w = windows[window_offsets[nuc] + window];
+	double background[3];
+	calculate_window_background( background, E, sqrt(E), 1.0 / E, w, window_offsets[nuc] + window, input.fit_order, curvefit );
+	sigT = background[0];
+	sigA = background[1];
+	sigF = background[2];
+
+	// Pole parameter arrays of this nuclide
+	unsigned long stride = pole_offsets[input.n_nuclides];
+	double * pole_base = poles_soa + pole_offsets[nuc];
+	double * EA_r = pole_base + POLE_EA_R * stride;
+	double * EA_i = pole_base + POLE_EA_I * stride;
+	double * RT_r = pole_base + POLE_RT_R * stride;
+	double * RT_i = pole_base + POLE_RT_I * stride;
+	double * RA_r = pole_base + POLE_RA_R * stride;
+	double * RA_i = pole_base + POLE_RA_I * stride;
+	double * RF_r = pole_base + POLE_RF_R * stride;
+	double * RF_i = pole_base + POLE_RF_I * stride;
+	short * l_value = pole_l_values + pole_offsets[nuc];
+	RSComplex E_c = {E, 0};
+	RSComplex dopp_c = {dopp, 0};
+
+	// Loop over Poles within window, add contributions, RSCOMPLEX_SIMD_WIDTH
+	// poles at a time (see faddeeva_W_vec), and the remaining poles one at a
+	// time
+	RSComplexVec E_v = cv_set1(E_c);
+	RSComplexVec dopp_v = cv_set1(dopp_c);
+	rs_vd sigT_v = rs_set1(0.0);
+	rs_vd sigA_v = rs_set1(0.0);
+	rs_vd sigF_v = rs_set1(0.0);
+	int i = w.start;
+	for( ; i + RSCOMPLEX_SIMD_WIDTH <= w.end; i += RSCOMPLEX_SIMD_WIDTH )
+	{
+		RSComplexVec MP_EA = cv_load(EA_r + i, EA_i + i);
+		RSComplexVec MP_RT = cv_load(RT_r + i, RT_i + i);
+		RSComplexVec MP_RA = cv_load(RA_r + i, RA_i + i);
+		RSComplexVec MP_RF = cv_load(RF_r + i, RF_i + i);
+		double f_r[RSCOMPLEX_SIMD_WIDTH];
+		double f_i[RSCOMPLEX_SIMD_WIDTH];
+		for( int k = 0; k < RSCOMPLEX_SIMD_WIDTH; k++ )
+		{
+			f_r[k] = sigTfactors[l_value[i+k]].r;
+			f_i[k] = sigTfactors[l_value[i+k]].i;
+		}
+
+		RSComplexVec Z = cv_mul(cv_sub(E_v, MP_EA), dopp_v);
+		RSComplexVec faddeeva = faddeeva_W_vec( Z, input.faddeeva, faddeeva_table );
+
+		sigT_v = rs_add(sigT_v, (cv_mul( MP_RT, cv_mul(faddeeva, cv_load(f_r, f_i)) )).r);
+		sigA_v = rs_add(sigA_v, (cv_mul( MP_RA , faddeeva)).r);
+		sigF_v = rs_add(sigF_v, (cv_mul( MP_RF , faddeeva)).r);
+	}
+	sigT += rs_sum(sigT_v);
+	sigA += rs_sum(sigA_v);
+	sigF += rs_sum(sigF_v);
+	for( ; i < w.end; i++ )
+	{
+		RSComplex MP_EA = {EA_r[i], EA_i[i]};
+		RSComplex MP_RT = {RT_r[i], RT_i[i]};
+		RSComplex MP_RA = {RA_r[i], RA_i[i]};
+		RSComplex MP_RF = {RF_r[i], RF_i[i]};
+
+		// Prep Z
+		RSComplex Z = c_mul(c_sub(E_c, MP_EA), dopp_c);
+
+		// Evaluate Fadeeva Function
+		RSComplex faddeeva = faddeeva_W( Z, input.faddeeva, faddeeva_table );
+
+		// Update W
+		sigT += (c_mul( MP_RT, c_mul(faddeeva, sigTfactors[l_value[i]]) )).r;
+		sigA += (c_mul( MP_RA , faddeeva)).r;
+		sigF += (c_mul( MP_RF , faddeeva)).r;
+	}
+
+	sigE = sigT - sigA;
+
+	micro_xs[0] = sigT;
+	micro_xs[1] = sigA;
+	micro_xs[2] = sigF;
+	micro_xs[3] = sigE;
+}
+
+// Contribution of the window "background" (i.e., poles outside the window,
+// pre-calculated) to sigT, sigA and sigF. Without a curve fit (-f 0), the
+// background is linear in E. With a curve fit of order N, it is the windowed
+// multipole fit (1/E) sum_{k=0..N} c_k sqrt(E)^k of the window, so it covers
+// the 1/E, 1/sqrt(E), 1, sqrt(E), ... terms of production WMP libraries. The
+// polynomial is evaluated with Horner's scheme in sqrt(E), for all three
+// channels at once (their coefficients are interleaved, see
+// generate_curvefit).
+void calculate_window_background( double * background, double E, double sqrt_E, double inv_E, Window w, int window_idx, int fit_order, double * curvefit )
+{
+	if( fit_order == 0 )
+	{
+		background[0] = E * w.T;
+		background[1] = E * w.A;
+		background[2] = E * w.F;
+		return;
+	}
+
+	double * c = curvefit + (unsigned long) window_idx * ( fit_order + 1 ) * CURVEFIT_CHANNELS;
+	double T = c[fit_order * CURVEFIT_CHANNELS + CURVEFIT_T];
+	double A = c[fit_order * CURVEFIT_CHANNELS + CURVEFIT_A];
+	double F = c[fit_order * CURVEFIT_CHANNELS + CURVEFIT_F];
+	for( int k = fit_order - 1; k >= 0; k-- )
+	{
+		T = T * sqrt_E + c[k * CURVEFIT_CHANNELS + CURVEFIT_T];
+		A = A * sqrt_E + c[k * CURVEFIT_CHANNELS + CURVEFIT_A];
+		F = F * sqrt_E + c[k * CURVEFIT_CHANNELS + CURVEFIT_F];
+	}
+
+	background[0] = T * inv_E;
+	background[1] = A * inv_E;
+	background[2] = F * inv_E;
+}
+
 // picks a material based on a probabilistic distribution
 int pick_mat( uint64_t * seed )
 {
@@ -370,21 +770,427 @@ RSComplex fast_nuclear_W( RSComplex Z )
 		return W;
 	}
 	else
+		return quick_2_W( Z );
+}
+
+
+// QUICK_2 3 Term Asymptotic Expansion (Accurate to O(1e-6)), used by the
+// Faddeeva evaluators for |Z| >= 6.
+RSComplex quick_2_W( RSComplex Z )
+{
+	// Pre-computed parameters
+	RSComplex a = {0.512424224754768462984202823134979415014943561548661637413182,0};
+	RSComplex b = {0.275255128608410950901357962647054304017026259671664935783653, 0};
+	RSComplex c = {0.051765358792987823963876628425793170829107067780337219430904, 0};
+	RSComplex d = {2.724744871391589049098642037352945695982973740328335064216346, 0};
+
+	RSComplex i = {0,1};
+	RSComplex Z2 = c_mul(Z, Z);
+	// Three Term Asymptotic Expansion
+	RSComplex W = c_mul(c_mul(Z,i), (c_add(c_div(a,(c_sub(Z2, b))) , c_div(c,(c_sub(Z2, d))))));
+
+	return W;
+}
+
+// Same approximation as fast_nuclear_W, with the terms that do not depend on
+// n hoisted out of the Abrarov series: e^(12iZ) and 144 Z^2 are computed once,
+// and as the numerator (-1)^(n+1) e^(12iZ) - 1 only takes two values, the
+// series is summed separately over even and odd n, and each partial sum is
+// multiplied by its numerator once. Agrees with fast_nuclear_W up to
+// rounding.
+RSComplex fused_nuclear_W( RSComplex Z )
+{
+	if( c_abs(Z) >= 6.0 )
+		return quick_2_W( Z );
+
+	// Precomputed parts for speeding things up
+	// (N = 10, Tm = 12.0)
+	RSComplex prefactor = {0, 8.124330e+01};
+	double an[10] = {
+		2.758402e-01,
+		2.245740e-01,
+		1.594149e-01,
+		9.866577e-02,
+		5.324414e-02,
+		2.505215e-02,
+		1.027747e-02,
+		3.676164e-03,
+		1.146494e-03,
+		3.117570e-04
+	};
+	double denominator_left[10] = {
+		9.869604e+00,
+		3.947842e+01,
+		8.882644e+01,
+		1.579137e+02,
+		2.467401e+02,
+		3.553058e+02,
+		4.836106e+02,
+		6.316547e+02,
+		7.994380e+02,
+		9.869604e+02
+	};
+
+	RSComplex t1 = {0, 12};
+	RSComplex t2 = {12, 0};
+	RSComplex i = {0,1};
+	RSComplex one = {1, 0};
+	RSComplex t5 = {144, 0};
+	RSComplex minus_one = {-1.0, 0};
+	RSComplex plus_one = {1.0, 0};
+
+	RSComplex e12 = fast_cexp(c_mul(t1, Z));
+	RSComplex Z2_144 = c_mul(t5, c_mul(Z,Z));
+	// (-1)^(n+1) e^(12iZ) - 1 for even and odd n
+	RSComplex top_even = c_sub(c_mul(minus_one, e12), one);
+	RSComplex top_odd = c_sub(c_mul(plus_one, e12), one);
+
+	RSComplex W = c_div(c_mul(i, ( c_sub(one, e12) )) , c_mul(t2, Z));
+	RSComplex sum_even = {0,0};
+	RSComplex sum_odd = {0,0};
+	for( int n = 0; n < 10; n += 2 )
 	{
-		// QUICK_2 3 Term Asymptotic Expansion (Accurate to O(1e-6)).
-		// Pre-computed parameters
-		RSComplex a = {0.512424224754768462984202823134979415014943561548661637413182,0};
-		RSComplex b = {0.275255128608410950901357962647054304017026259671664935783653, 0};
-		RSComplex c = {0.051765358792987823963876628425793170829107067780337219430904, 0};
-		RSComplex d = {2.724744871391589049098642037352945695982973740328335064216346, 0};
+		RSComplex t4 = {denominator_left[n], 0};
+		RSComplex t6 = {an[n], 0};
+		sum_even = c_add(sum_even, c_div(t6, c_sub(t4, Z2_144)));
+		t4.r = denominator_left[n+1];
+		t6.r = an[n+1];
+		sum_odd = c_add(sum_odd, c_div(t6, c_sub(t4, Z2_144)));
+	}
+	RSComplex sum = c_add(c_mul(top_even, sum_even), c_mul(top_odd, sum_odd));
+	W = c_add(W, c_mul(prefactor, c_mul(Z, sum)));
+	return W;
+}
 
-		RSComplex i = {0,1};
-		RSComplex Z2 = c_mul(Z, Z);
-		// Three Term Asymptotic Expansion
-		RSComplex W = c_mul(c_mul(Z,i), (c_add(c_div(a,(c_sub(Z2, b))) , c_div(c,(c_sub(Z2, d))))));
+// Humlicek's w4 approximation (J. Quant. Spectrosc. Radiat. Transfer 27,
+// 1982), which splits the upper half-plane into four regions with rational
+// approximations of increasing order. Only valid for Im(Z) >= 0.
+RSComplex humlicek_w4( RSComplex Z )
+{
+	// t = y - ix
+	RSComplex t = {Z.i, -Z.r};
+	double s = fabs(Z.r) + Z.i;
+
+	// Region I
+	if( s >= 15.0 )
+	{
+		RSComplex k = {0.5641896, 0};
+		RSComplex half = {0.5, 0};
+		return c_div(c_mul(t, k), c_add(half, c_mul(t, t)));
+	}
+
+	// Region II
+	if( s >= 5.5 )
+	{
+		RSComplex u = c_mul(t, t);
+		RSComplex num = {1.410474 + 0.5641896 * u.r, 0.5641896 * u.i};
+		RSComplex den = {3.0 + u.r, u.i};
+		den = c_mul(u, den);
+		den.r += 0.75;
+		return c_div(c_mul(t, num), den);
+	}
+
+	// Region III
+	if( Z.i >= 0.195 * fabs(Z.r) - 0.176 )
+	{
+		double num_c[5] = {0.5642236, 3.778987, 11.96482, 20.20933, 16.4955};
+		double den_c[6] = {1.0, 6.699398, 21.69274, 39.27121, 38.82363, 16.4955};
+		RSComplex num = {num_c[0], 0};
+		for( int k = 1; k < 5; k++ )
+		{
+			num = c_mul(num, t);
+			num.r += num_c[k];
+		}
+		RSComplex den = {den_c[0], 0};
+		for( int k = 1; k < 6; k++ )
+		{
+			den = c_mul(den, t);
+			den.r += den_c[k];
+		}
+		return c_div(num, den);
+	}
+
+	// Region IV
+	double num_c[7] = {0.56419, -1.320522, 35.76683, -219.0313, 1540.787, -3321.9905, 36183.31};
+	double den_c[8] = {-1.0, 1.841439, -61.57037, 364.2191, -2186.181, 9022.228, -24322.84, 32066.6};
+	RSComplex u = c_mul(t, t);
+	RSComplex num = {num_c[0], 0};
+	for( int k = 1; k < 7; k++ )
+	{
+		num = c_mul(num, u);
+		num.r += num_c[k];
+	}
+	RSComplex den = {den_c[0], 0};
+	for( int k = 1; k < 8; k++ )
+	{
+		den = c_mul(den, u);
+		den.r += den_c[k];
+	}
+	// e^u is not well approximated by fast_cexp for the large |u| of this
+	// region, so the libm exponential is used
+	double eu = exp(u.r);
+	RSComplex exp_u = {eu * cos(u.i), eu * sin(u.i)};
+	return c_sub(exp_u, c_div(c_mul(t, num), den));
+}
+
+// Parameters of the Weideman approximation (L = 2^(-1/4) sqrt(N), and the
+// coefficients of p from the lowest to the highest degree)
+#define WEIDEMAN_L 4.75682846001088426718
+#define WEIDEMAN_COEFFS { \
+	 2.57225340812456915e+00, \
+	 2.26353729990026764e+00, \
+	 1.82566962963248081e+00, \
+	 1.34554416923454445e+00, \
+	 9.01925489364798993e-01, \
+	 5.46013972063933095e-01, \
+	 2.95444510715086150e-01, \
+	 1.40607162268936714e-01, \
+	 5.73044035298361162e-02, \
+	 1.90061557848444605e-02, \
+	 4.51954110534831966e-03, \
+	 3.92591360699860194e-04, \
+	-2.45329802701086720e-04, \
+	-1.30754492546990514e-04, \
+	-2.14096192027037708e-05, \
+	 6.82103194311755201e-06, \
+	 4.40153173064848570e-06, \
+	 4.25583312856679197e-07, \
+	-4.18407637989703528e-07, \
+	-1.48130790035918853e-07, \
+	 2.29304381963116462e-08, \
+	 2.37975558974265499e-08, \
+	 8.12488137329919237e-10, \
+	-3.20801597910252241e-09, \
+	-5.23102959809862130e-10, \
+	 4.15373477163937833e-10, \
+	 1.16581620804968129e-10, \
+	-5.54432534496766827e-11, \
+	-2.15444088130523894e-11, \
+	 8.02961963616128337e-12, \
+	 3.74028962726050346e-12, \
+	-1.30405047995743029e-12 }
+
+// Weideman's rational approximation (SIAM J. Numer. Anal. 31, 1994) with
+// N = 32 terms: w(Z) = 2 p(X) / (L - iZ)^2 + (1/sqrt(pi)) / (L - iZ), where
+// X = (L + iZ) / (L - iZ) and p is a polynomial of degree N - 1. Only valid
+// for Im(Z) >= 0.
+RSComplex weideman_w( RSComplex Z )
+{
+	// Precomputed parts (see WEIDEMAN_COEFFS)
+	double L = WEIDEMAN_L;
+	double coeff[32] = WEIDEMAN_COEFFS;
+
+	// L + iZ, and 1 / (L - iZ), which is used three times
+	RSComplex lpiz = {L - Z.i, Z.r};
+	double lmiz_r = L + Z.i;
+	double lmiz_i = -Z.r;
+	double denom = 1.0 / ( lmiz_r * lmiz_r + lmiz_i * lmiz_i );
+	RSComplex inv_lmiz = {lmiz_r * denom, -lmiz_i * denom};
+	RSComplex X = c_mul(lpiz, inv_lmiz);
+
+	// p(X) = p_even(X^2) + X p_odd(X^2), with both halves evaluated by
+	// Horner's rule, which halves the length of the dependency chain
+	RSComplex X2 = c_mul(X, X);
+	RSComplex p_even = {coeff[30], 0};
+	RSComplex p_odd = {coeff[31], 0};
+	for( int n = 14; n >= 0; n-- )
+	{
+		p_even = c_mul(p_even, X2);
+		p_even.r += coeff[2*n];
+		p_odd = c_mul(p_odd, X2);
+		p_odd.r += coeff[2*n+1];
+	}
+	RSComplex p = c_add(p_even, c_mul(X, p_odd));
+
+	// (2 p(X) / (L - iZ) + 1/sqrt(pi)) / (L - iZ)
+	RSComplex W = c_mul(p, inv_lmiz);
+	W.r = 2.0 * W.r + 0.56418958354775628695;
+	W.i = 2.0 * W.i;
+	return c_mul(W, inv_lmiz);
+}
+
+// Bilinear interpolation of w(Z) from the precomputed table (see
+// generate_faddeeva_table) for |Z| < 6, and the asymptotic expansion
+// otherwise. The table only covers Im(Z) >= 0, so the lower half-plane uses
+// W(Z) = -conj(w(conj(Z))).
+RSComplex table_nuclear_W( RSComplex Z, RSComplex * table )
+{
+	if( c_abs(Z) >= 6.0 )
+		return quick_2_W( Z );
+
+	double fx = ( Z.r + FADDEEVA_TABLE_RADIUS ) / FADDEEVA_TABLE_STEP;
+	double fy = fabs(Z.i) / FADDEEVA_TABLE_STEP;
+	int ix = (int) fx;
+	int iy = (int) fy;
+	if( ix > FADDEEVA_TABLE_NX - 2 )
+		ix = FADDEEVA_TABLE_NX - 2;
+	if( iy > FADDEEVA_TABLE_NY - 2 )
+		iy = FADDEEVA_TABLE_NY - 2;
+	double dx = fx - ix;
+	double dy = fy - iy;
+
+	RSComplex * low  = table + iy * FADDEEVA_TABLE_NX + ix;
+	RSComplex * high = low + FADDEEVA_TABLE_NX;
+	RSComplex W;
+	W.r = (1.0 - dy) * ( (1.0 - dx) * low[0].r + dx * low[1].r ) + dy * ( (1.0 - dx) * high[0].r + dx * high[1].r );
+	W.i = (1.0 - dy) * ( (1.0 - dx) * low[0].i + dx * low[1].i ) + dy * ( (1.0 - dx) * high[0].i + dx * high[1].i );
+
+	if( Z.i < 0 )
+		W.r = -W.r;
+	return W;
+}
+
+// QUICK_2 expansion (see quick_2_W) of RSCOMPLEX_SIMD_WIDTH arguments
+RSComplexVec quick_2_W_vec( RSComplexVec Z )
+{
+	// Pre-computed parameters
+	RSComplex a = {0.512424224754768462984202823134979415014943561548661637413182,0};
+	RSComplex b = {0.275255128608410950901357962647054304017026259671664935783653, 0};
+	RSComplex c = {0.051765358792987823963876628425793170829107067780337219430904, 0};
+	RSComplex d = {2.724744871391589049098642037352945695982973740328335064216346, 0};
+	RSComplex i = {0,1};
+	RSComplexVec a_v = cv_set1(a);
+	RSComplexVec b_v = cv_set1(b);
+	RSComplexVec c_v = cv_set1(c);
+	RSComplexVec d_v = cv_set1(d);
+	RSComplexVec i_v = cv_set1(i);
+
+	RSComplexVec Z2 = cv_mul(Z, Z);
+	// Three Term Asymptotic Expansion
+	return cv_mul(cv_mul(Z,i_v), (cv_add(cv_div(a_v,(cv_sub(Z2, b_v))) , cv_div(c_v,(cv_sub(Z2, d_v))))));
+}
+
+// Weideman approximation (see weideman_w) of RSCOMPLEX_SIMD_WIDTH arguments
+// in the upper half-plane. It has no branches, so all lanes are evaluated at
+// once.
+RSComplexVec weideman_w_vec( RSComplexVec Z )
+{
+	double L = WEIDEMAN_L;
+	double coeff[32] = WEIDEMAN_COEFFS;
+	rs_vd zero = rs_set1(0.0);
+	rs_vd L_v = rs_set1(L);
+
+	// L + iZ, and 1 / (L - iZ)
+	RSComplexVec lpiz = {rs_sub(L_v, Z.i), Z.r};
+	rs_vd lmiz_r = rs_add(L_v, Z.i);
+	rs_vd lmiz_i = rs_sub(zero, Z.r);
+	rs_vd denom = rs_div(rs_set1(1.0), rs_add(rs_mul(lmiz_r, lmiz_r), rs_mul(lmiz_i, lmiz_i)));
+	RSComplexVec inv_lmiz = {rs_mul(lmiz_r, denom), rs_sub(zero, rs_mul(lmiz_i, denom))};
+	RSComplexVec X = cv_mul(lpiz, inv_lmiz);
+
+	// p(X) = p_even(X^2) + X p_odd(X^2)
+	RSComplexVec X2 = cv_mul(X, X);
+	RSComplexVec p_even = {rs_set1(coeff[30]), zero};
+	RSComplexVec p_odd = {rs_set1(coeff[31]), zero};
+	for( int n = 14; n >= 0; n-- )
+	{
+		p_even = cv_mul(p_even, X2);
+		p_even.r = rs_add(p_even.r, rs_set1(coeff[2*n]));
+		p_odd = cv_mul(p_odd, X2);
+		p_odd.r = rs_add(p_odd.r, rs_set1(coeff[2*n+1]));
+	}
+	RSComplexVec p = cv_add(p_even, cv_mul(X, p_odd));
+
+	// (2 p(X) / (L - iZ) + 1/sqrt(pi)) / (L - iZ)
+	RSComplexVec W = cv_mul(p, inv_lmiz);
+	W.r = rs_add(rs_mul(rs_set1(2.0), W.r), rs_set1(0.56418958354775628695));
+	W.i = rs_mul(rs_set1(2.0), W.i);
+	return cv_mul(W, inv_lmiz);
+}
+
+// Region I of humlicek_w4 (|Re(Z)| + Im(Z) >= 15) of RSCOMPLEX_SIMD_WIDTH
+// arguments in the upper half-plane
+RSComplexVec humlicek_w4_region1_vec( RSComplexVec Z )
+{
+	RSComplex k = {0.5641896, 0};
+	RSComplex half = {0.5, 0};
+
+	// t = y - ix
+	RSComplexVec t = {Z.i, rs_sub(rs_set1(0.0), Z.r)};
+	return cv_div(cv_mul(t, cv_set1(k)), cv_add(cv_set1(half), cv_mul(t, t)));
+}
 
+// Evaluates the Faddeeva function of RSCOMPLEX_SIMD_WIDTH arguments with the
+// evaluator selected by -F. Nearly all arguments of the Doppler kernel have a
+// large |Z|, so the branch these take is evaluated for all lanes at once: the
+// asymptotic expansion of the default, fused and table evaluators, and region
+// I of Humlicek's approximation. The lanes that need another branch (|Z| < 6,
+// or regions II-IV) are then redone one at a time with the scalar evaluator:
+// the rs_vd operations have no per-lane compare and select, and the Abrarov
+// series and the higher order Humlicek regions are taken by too few arguments
+// to be worth masking. The Weideman approximation has no branches, and is
+// evaluated for all lanes at once.
+RSComplexVec faddeeva_W_vec( RSComplexVec Z, int evaluator, RSComplex * table )
+{
+	double Z_r[RSCOMPLEX_SIMD_WIDTH];
+	double Z_i[RSCOMPLEX_SIMD_WIDTH];
+	double W_r[RSCOMPLEX_SIMD_WIDTH];
+	double W_i[RSCOMPLEX_SIMD_WIDTH];
+	cv_store(Z_r, Z_i, Z);
+
+	// The Humlicek and Weideman approximations are evaluated in the upper
+	// half-plane (see faddeeva_W)
+	if( evaluator == FADDEEVA_HUMLICEK || evaluator == FADDEEVA_WEIDEMAN )
+	{
+		double Z_upper_i[RSCOMPLEX_SIMD_WIDTH];
+		for( int k = 0; k < RSCOMPLEX_SIMD_WIDTH; k++ )
+			Z_upper_i[k] = fabs(Z_i[k]);
+		RSComplexVec Z_upper = cv_load(Z_r, Z_upper_i);
+		if( evaluator == FADDEEVA_WEIDEMAN )
+			cv_store(W_r, W_i, weideman_w_vec( Z_upper ));
+		else
+			cv_store(W_r, W_i, humlicek_w4_region1_vec( Z_upper ));
+
+		for( int k = 0; k < RSCOMPLEX_SIMD_WIDTH; k++ )
+		{
+			if( evaluator == FADDEEVA_HUMLICEK && fabs(Z_r[k]) + Z_upper_i[k] < 15.0 )
+			{
+				RSComplex z = {Z_r[k], Z_upper_i[k]};
+				RSComplex W = humlicek_w4( z );
+				W_r[k] = W.r;
+				W_i[k] = W.i;
+			}
+			if( Z_i[k] < 0 )
+				W_r[k] = -W_r[k];
+		}
+		return cv_load(W_r, W_i);
+	}
+
+	cv_store(W_r, W_i, quick_2_W_vec( Z ));
+	for( int k = 0; k < RSCOMPLEX_SIMD_WIDTH; k++ )
+	{
+		RSComplex z = {Z_r[k], Z_i[k]};
+		if( c_abs(z) < 6.0 )
+		{
+			RSComplex W = faddeeva_W( z, evaluator, table );
+			W_r[k] = W.r;
+			W_i[k] = W.i;
+		}
+	}
+
+	return cv_load(W_r, W_i);
+}
+
+// Evaluates the Faddeeva function with the evaluator selected by -F. The
+// default and fused evaluators give the same results. The Humlicek and
+// Weideman approximations are evaluated in the upper half-plane, and use
+// W(Z) = -conj(w(conj(Z))) below it (which the asymptotic expansion of the
+// other evaluators also satisfies).
+RSComplex faddeeva_W( RSComplex Z, int evaluator, RSComplex * table )
+{
+	if( evaluator == FADDEEVA_FUSED )
+		return fused_nuclear_W( Z );
+	if( evaluator == FADDEEVA_TABLE )
+		return table_nuclear_W( Z, table );
+	if( evaluator == FADDEEVA_HUMLICEK || evaluator == FADDEEVA_WEIDEMAN )
+	{
+		RSComplex Z_upper = {Z.r, fabs(Z.i)};
+		RSComplex W = ( evaluator == FADDEEVA_HUMLICEK ) ? humlicek_w4( Z_upper ) : weideman_w( Z_upper );
+		if( Z.i < 0 )
+			W.r = -W.r;
 		return W;
 	}
+	return fast_nuclear_W( Z );
 }
 
 double LCG_random_double(uint64_t * seed)
@@ -432,86 +1238,412 @@ uint64_t fast_forward_LCG(uint64_t seed, uint64_t n)
 	return (a_new * seed + c_new) % m;
 }
 
-// Complex arithmetic functions
+////////////////////////////////////////////////////////////////////////////////////
+// OPTIMIZED VARIANT FUNCTIONS
+////////////////////////////////////////////////////////////////////////////////////
+// This section contains a number of optimized variants of some of the above
+// functions, which each deploy a different combination of optimizations
+// strategies. By default, RSBench will not run any of these variants. They
+// must be specifically selected using the "-k <optimized variant ID>" command
+// line argument.
+////////////////////////////////////////////////////////////////////////////////////
 
-RSComplex c_add( RSComplex A, RSComplex B)
+// Variant of calculate_sig_T that takes sqrt(E), which is the same for all
+// nuclides of a lookup
+void calculate_sig_T_hoisted( int nuc, double sqrt_E, Input input, double * pseudo_K0RS, RSComplex * sigTfactors )
 {
-	RSComplex C;
-	C.r = A.r + B.r;
-	C.i = A.i + B.i;
-	return C;
+	double phi;
+
+	for( int i = 0; i < 4; i++ )
+	{
+		phi = pseudo_K0RS[nuc * input.numL + i] * sqrt_E;
+
+		if( i == 1 )
+			phi -= - atan( phi );
+		else if( i == 2 )
+			phi -= atan( 3.0 * phi / (3.0 - phi*phi));
+		else if( i == 3 )
+			phi -= atan(phi*(15.0-phi*phi)/(15.0-6.0*phi*phi));
+
+		phi *= 2.0;
+
+		sigTfactors[i].r = cos(phi);
+		sigTfactors[i].i = -sin(phi);
+	}
 }
 
-RSComplex c_sub( RSComplex A, RSComplex B)
+// Variant of calculate_micro_xs with the energy terms hoisted out of the pole
+// loop. The baseline computes CDUM = (i / (MP_EA - sqrt(E))) / E with two
+// complex divisions per pole. Here, sqrt(E) and 1/E are computed once per
+// lookup, and i / d = (Im(d) + i Re(d)) / |d|^2, so each pole needs a single
+// real division. Only the real parts of the pole contributions are needed, so
+// the c_mul chains are fused into real multiply-adds.
+void calculate_micro_xs_hoisted( double * micro_xs, int nuc, double E, double sqrt_E, double inv_E, Input input, int * n_windows, double * pseudo_K0RS, Window * windows, Pole * poles, int * window_offsets, int * pole_offsets, double * curvefit )
 {
-	RSComplex C;
-	C.r = A.r - B.r;
-	C.i = A.i - B.i;
-	return C;
+	// Calculate Window Index
+	double spacing = 1.0 / n_windows[nuc];
+	int window = (int) ( E / spacing );
+	if( window == n_windows[nuc] )
+		window--;
+
+	// Calculate sigTfactors
+	RSComplex sigTfactors[4]; // Of length input.numL, which is always 4
+	calculate_sig_T_hoisted(nuc, sqrt_E, input, pseudo_K0RS, sigTfactors );
+
+	// Calculate contributions from window "background" (i.e., poles outside window (pre-calculated)
+	Window w = windows[window_offsets[nuc] + window];
+	double background[3];
+	calculate_window_background( background, E, sqrt_E, inv_E, w, window_offsets[nuc] + window, input.fit_order, curvefit );
+	double sigT = background[0];
+	double sigA = background[1];
+	double sigF = background[2];
+
+	// Loop over Poles within window, add contributions
+	Pole * pole = poles + pole_offsets[nuc];
+	for( int i = w.start; i < w.end; i++ )
+	{
+		// CDUM = i / (MP_EA - sqrt(E)) / E
+		double d_r = pole[i].MP_EA.r - sqrt_E;
+		double d_i = pole[i].MP_EA.i;
+		double scale = inv_E / ( d_r * d_r + d_i * d_i );
+		double cdum_r = d_i * scale;
+		double cdum_i = d_r * scale;
+
+		// Real parts of MP_RT * CDUM * sigTfactor, MP_RA * CDUM and MP_RF * CDUM
+		RSComplex f = sigTfactors[pole[i].l_value];
+		double t_r = cdum_r * f.r - cdum_i * f.i;
+		double t_i = cdum_r * f.i + cdum_i * f.r;
+		sigT += pole[i].MP_RT.r * t_r - pole[i].MP_RT.i * t_i;
+		sigA += pole[i].MP_RA.r * cdum_r - pole[i].MP_RA.i * cdum_i;
+		sigF += pole[i].MP_RF.r * cdum_r - pole[i].MP_RF.i * cdum_i;
+	}
+
+	micro_xs[0] = sigT;
+	micro_xs[1] = sigA;
+	micro_xs[2] = sigF;
+	micro_xs[3] = sigT - sigA;
 }
 
-RSComplex c_mul( RSComplex A, RSComplex B)
+// Variant of calculate_micro_xs_doppler with the same hoisting and fusion as
+// calculate_micro_xs_hoisted. Z = (E - MP_EA) * dopp is formed directly
+// instead of with complex products.
+void calculate_micro_xs_doppler_hoisted( double * micro_xs, int nuc, double E, double sqrt_E, Input input, int * n_windows, double * pseudo_K0RS, Window * windows, Pole * poles, int * window_offsets, int * pole_offsets, double * curvefit, RSComplex * faddeeva_table, double dopp )
 {
-	double a = A.r;
-	double b = A.i;
-	double c = B.r;
-	double d = B.i;
-	RSComplex C;
-	C.r = (a*c) - (b*d);
-	C.i = (a*d) + (b*c);
-	return C;
+	// Calculate Window Index
+	double spacing = 1.0 / n_windows[nuc];
+	int window = (int) ( E / spacing );
+	if( window == n_windows[nuc] )
+		window--;
+
+	// Calculate sigTfactors
+	RSComplex sigTfactors[4]; // Of length input.numL, which is always 4
+	calculate_sig_T_hoisted(nuc, sqrt_E, input, pseudo_K0RS, sigTfactors );
+
+	// Calculate contributions from window "background" (i.e., poles outside window (pre-calculated)
+	Window w = windows[window_offsets[nuc] + window];
+	double background[3];
+	calculate_window_background( background, E, sqrt_E, 1.0 / E, w, window_offsets[nuc] + window, input.fit_order, curvefit );
+	double sigT = background[0];
+	double sigA = background[1];
+	double sigF = background[2];
+
+	// Loop over Poles within window, add contributions
+	Pole * pole = poles + pole_offsets[nuc];
+	for( int i = w.start; i < w.end; i++ )
+	{
+		RSComplex Z = {(E - pole[i].MP_EA.r) * dopp, -pole[i].MP_EA.i * dopp};
+
+		// Evaluate Fadeeva Function
+		RSComplex faddeeva = faddeeva_W( Z, input.faddeeva, faddeeva_table );
+
+		// Real parts of MP_RT * W * sigTfactor, MP_RA * W and MP_RF * W
+		RSComplex f = sigTfactors[pole[i].l_value];
+		double t_r = faddeeva.r * f.r - faddeeva.i * f.i;
+		double t_i = faddeeva.r * f.i + faddeeva.i * f.r;
+		sigT += pole[i].MP_RT.r * t_r - pole[i].MP_RT.i * t_i;
+		sigA += pole[i].MP_RA.r * faddeeva.r - pole[i].MP_RA.i * faddeeva.i;
+		sigF += pole[i].MP_RF.r * faddeeva.r - pole[i].MP_RF.i * faddeeva.i;
+	}
+
+	micro_xs[0] = sigT;
+	micro_xs[1] = sigA;
+	micro_xs[2] = sigF;
+	micro_xs[3] = sigT - sigA;
 }
 
-RSComplex c_div( RSComplex A, RSComplex B)
+// Variant of calculate_macro_xs that computes sqrt(E) and 1/E once per
+// lookup, for the hoisted micro XS kernels. Reads the AoS pole layout.
+void calculate_macro_xs_hoisted( double * macro_xs, int mat, double E, Input input, int * num_nucs, int * mats, int max_num_nucs, double * concs, int * n_windows, double * pseudo_K0Rs, Window * windows, Pole * poles, int * window_offsets, int * pole_offsets, double * curvefit, RSComplex * faddeeva_table, double * dopp )
 {
-	double a = A.r;
-	double b = A.i;
-	double c = B.r;
-	double d = B.i;
-	RSComplex C;
-	double denom = c*c + d*d;
-	C.r = ( (a*c) + (b*d) ) / denom;
-	C.i = ( (b*c) - (a*d) ) / denom;
-	return C;
+	double sqrt_E = sqrt(E);
+	double inv_E = 1.0 / E;
+
+	// zero out macro vector
+	for( int i = 0; i < 4; i++ )
+		macro_xs[i] = 0;
+
+	// for nuclide in mat
+	for( int i = 0; i < num_nucs[mat]; i++ )
+	{
+		double micro_xs[4];
+		int nuc = mats[mat * max_num_nucs + i];
+
+		if( input.doppler == 1 )
+			calculate_micro_xs_doppler_hoisted( micro_xs, nuc, E, sqrt_E, input, n_windows, pseudo_K0Rs, windows, poles, window_offsets, pole_offsets, curvefit, faddeeva_table, dopp[mat] );
+		else
+			calculate_micro_xs_hoisted( micro_xs, nuc, E, sqrt_E, inv_E, input, n_windows, pseudo_K0Rs, windows, poles, window_offsets, pole_offsets, curvefit );
+
+		for( int j = 0; j < 4; j++ )
+			macro_xs[j] += micro_xs[j] * concs[mat * max_num_nucs + i];
+	}
 }
 
-double c_abs( RSComplex A)
+void run_event_based_simulation_optimization_1(Input input, SimulationData data, unsigned long * vhash_result )
 {
-	return sqrt(A.r*A.r + A.i * A.i);
-}
+	printf("Beginning event based simulation (hoisted energy terms)...\n");
+
+	////////////////////////////////////////////////////////////////////////////////
+	// OPTIMIZATION 1: Hoisted Energy Terms
+	// The baseline lookup recomputes terms that only depend on the energy for
+	// every pole and nuclide: sqrt(E), and two complex divisions by values
+	// built from E. Here, sqrt(E) and 1/E are computed once per lookup, the
+	// complex divisions are replaced by a real reciprocal multiply, and only
+	// the real parts of the pole contributions are accumulated (see
+	// calculate_micro_xs_hoisted). The kernel reads the AoS pole layout.
+	// Lookups are split between the devices like in the baseline.
+	// If no devices are available, the target region is run on the host
+	// (i.e., the initial device) instead.
+	////////////////////////////////////////////////////////////////////////////////
+	int num_devices = omp_get_num_devices();
+	int on_host = ( num_devices == 0 );
+	if( on_host )
+		num_devices = 1;
+	unsigned long chunk = input.lookups/num_devices;
 
+	printf("Num Devices: %d\nChunk Size: %lu\n", on_host ? 0 : num_devices, chunk);
 
-// Fast (but inaccurate) exponential function
-// Written By "ACMer":
-// https://codingforspeed.com/using-faster-exponential-approximation/
-// We use our own to avoid small differences in compiler specific
-// exp() intrinsic implementations that make it difficult to verify
-// if the code is working correctly or not.
-double fast_exp(double x)
-{
-  x = 1.0 + x * 0.000244140625;
-  x *= x; x *= x; x *= x; x *= x;
-  x *= x; x *= x; x *= x; x *= x;
-  x *= x; x *= x; x *= x; x *= x;
-  return x;
+	unsigned long long validation_hash = 0;
+
+	#pragma omp parallel for num_threads(num_devices) reduction(+:validation_hash)
+	for (int K = 0; K < num_devices; K++) {
+		int device = on_host ? omp_get_initial_device() : K;
+		unsigned long first = K * chunk;
+		unsigned long last  = first + ((K == num_devices-1) ? chunk + input.lookups%num_devices : chunk);
+		unsigned long long validation_hash_k = 0;
+
+		#pragma omp target teams distribute parallel for reduction(+:validation_hash_k) \
+				map(to:data.n_windows[:data.length_n_windows]) \
+				map(to:data.poles[:data.length_poles]) \
+				map(to:data.windows[:data.length_windows]) \
+				map(to:data.curvefit[:data.length_curvefit]) \
+				map(to:data.pseudo_K0RS[:data.length_pseudo_K0RS]) \
+				map(to:data.num_nucs[:data.length_num_nucs]) \
+				map(to:data.mats[:data.length_mats]) \
+				map(to:data.concs[:data.length_concs]) \
+				map(to:data.max_num_nucs) \
+				map(to:data.pole_offsets[:data.length_pole_offsets]) \
+				map(to:data.window_offsets[:data.length_window_offsets]) \
+				map(to:data.faddeeva_table[:data.length_faddeeva_table]) \
+				map(to:data.dopp[:data.length_dopp]) \
+				map(tofrom:validation_hash_k) \
+		        device(device)
+		for( unsigned long i = first; i < last; i++ )
+		{
+			// Forward seed to lookup index (we need 2 samples per lookup)
+			uint64_t seed = fast_forward_LCG(STARTING_SEED, 2*i);
+
+			// Randomly pick an energy and material for the particle
+			double E = LCG_random_double(&seed);
+			int mat  = pick_mat(&seed);
+
+			double macro_xs[4];
+			calculate_macro_xs_hoisted( macro_xs, mat, E, input, data.num_nucs, data.mats, data.max_num_nucs,
+			                            data.concs, data.n_windows, data.pseudo_K0RS, data.windows, data.poles,
+			                            data.window_offsets, data.pole_offsets, data.curvefit, data.faddeeva_table, data.dopp );
+
+			// For verification, and to prevent the compiler from optimizing
+			// all work out, we interrogate the returned macro_xs_vector array
+			// to find its maximum value index, then increment the verification
+			// value by that index.
+			double max = -DBL_MAX;
+			int max_idx = 0;
+			for(int x = 0; x < 4; x++ )
+			{
+				if( macro_xs[x] > max )
+				{
+					max = macro_xs[x];
+					max_idx = x;
+				}
+			}
+			validation_hash_k += max_idx+1;
+		}
+
+		validation_hash += validation_hash_k;
+	}
+
+	// Print if kernel actually ran on the device
+	if( !on_host )
+		printf( "Kernel ran accelerator device.\n" );
+	else
+		printf( "NOTE - Kernel ran on the host!\n" );
+
+	*vhash_result = validation_hash;
 }
 
-// Implementation based on:
-// z = x + iy
-// cexp(z) = e^x * (cos(y) + i * sin(y))
-RSComplex fast_cexp( RSComplex z )
+void run_event_based_simulation_optimization_2(Input input, SimulationData data, unsigned long * vhash_result )
 {
-	double x = z.r;
-	double y = z.i;
-
-	// For consistency across architectures, we
-	// will use our own exponetial implementation
-	//double t1 = exp(x);
-	double t1 = fast_exp(x);
-	double t2 = cos(y);
-	double t3 = sin(y);
-	RSComplex t4 = {t2, t3};
-	RSComplex t5 = {t1, 0};
-	RSComplex result = c_mul(t5, (t4));
-	return result;
-}	
+	printf("Beginning event based simulation (material sorted lookups)...\n");
+
+	////////////////////////////////////////////////////////////////////////////////
+	// OPTIMIZATION 2: Material Sorted Lookups
+	// Lookups are run in batches of SORT_BATCH_LOOKUPS. Each batch is sampled
+	// on the device exactly as in the baseline, bucketed by material, and then
+	// run in material order with the hoisted kernels of optimization 1. The
+	// fuel has far more nuclides than any other material, so when lookups of
+	// all materials are mixed, threads of the same team loop over very
+	// different numbers of nuclides. In material order, neighboring threads
+	// run the same nuclide loop, and share the rows of mats and concs. The
+	// verification hash is a sum over all lookups, so the order does not
+	// change it.
+	// Lookups are split between the devices like in the baseline.
+	// If no devices are available, the target regions are run on the host
+	// (i.e., the initial device) instead.
+	////////////////////////////////////////////////////////////////////////////////
+	int num_devices = omp_get_num_devices();
+	int on_host = ( num_devices == 0 );
+	if( on_host )
+		num_devices = 1;
+	int n_mats = data.length_num_nucs;
+	unsigned long chunk = input.lookups/num_devices;
+
+	printf("Num Devices: %d\nChunk Size: %lu\nSort Batch Size: %d\n", on_host ? 0 : num_devices, chunk, SORT_BATCH_LOOKUPS);
+
+	unsigned long long validation_hash = 0;
+
+	#pragma omp parallel for num_threads(num_devices) reduction(+:validation_hash)
+	for (int K = 0; K < num_devices; K++) {
+		int device = on_host ? omp_get_initial_device() : K;
+		int host_device = omp_get_initial_device();
+		unsigned long first = K * chunk;
+		unsigned long last  = first + ((K == num_devices-1) ? chunk + input.lookups%num_devices : chunk);
+		unsigned long long validation_hash_k = 0;
+
+		// Batch samples, batch offsets in material order, and the
+		// per-material counts and queue cursors
+		long max_n = ( last - first < SORT_BATCH_LOOKUPS ) ? last - first : SORT_BATCH_LOOKUPS;
+		double * energy_d = (double *) omp_target_alloc( max_n * sizeof(double), device);
+		int    * mat_d    = (int *)    omp_target_alloc( max_n * sizeof(int), device);
+		int    * queue_d  = (int *)    omp_target_alloc( max_n * sizeof(int), device);
+		long   * count_d  = (long *)   omp_target_alloc( n_mats * sizeof(long), device);
+		assert(energy_d != NULL && mat_d != NULL && queue_d != NULL && count_d != NULL);
+
+		long count[n_mats];
+		long offset[n_mats];
+
+		#pragma omp target data \
+				map(to:data.n_windows[:data.length_n_windows]) \
+				map(to:data.poles[:data.length_poles]) \
+				map(to:data.windows[:data.length_windows]) \
+				map(to:data.curvefit[:data.length_curvefit]) \
+				map(to:data.pseudo_K0RS[:data.length_pseudo_K0RS]) \
+				map(to:data.num_nucs[:data.length_num_nucs]) \
+				map(to:data.mats[:data.length_mats]) \
+				map(to:data.concs[:data.length_concs]) \
+				map(to:data.pole_offsets[:data.length_pole_offsets]) \
+				map(to:data.window_offsets[:data.length_window_offsets]) \
+				map(to:data.faddeeva_table[:data.length_faddeeva_table]) \
+				map(to:data.dopp[:data.length_dopp]) \
+				device(device)
+		for( unsigned long start = first; start < last; start += SORT_BATCH_LOOKUPS )
+		{
+			long n = ( last - start < SORT_BATCH_LOOKUPS ) ? last - start : SORT_BATCH_LOOKUPS;
+
+			// Sample the batch, and count the lookups of each material
+			#pragma omp target teams distribute parallel for is_device_ptr(count_d) device(device)
+			for( int m = 0; m < n_mats; m++ )
+				count_d[m] = 0;
+
+			#pragma omp target teams distribute parallel for is_device_ptr(energy_d, mat_d, count_d) device(device)
+			for( long j = 0; j < n; j++ )
+			{
+				// Forward seed to lookup index (we need 2 samples per lookup)
+				uint64_t seed = fast_forward_LCG(STARTING_SEED, 2*(start + j));
+
+				// Randomly pick an energy and material for the particle
+				energy_d[j] = LCG_random_double(&seed);
+				mat_d[j]    = pick_mat(&seed);
+
+				#pragma omp atomic
+				count_d[mat_d[j]]++;
+			}
+
+			// Start of each material's lookups
+			omp_target_memcpy(count, count_d, n_mats*sizeof(long), 0, 0, host_device, device);
+			offset[0] = 0;
+			for( int m = 1; m < n_mats; m++ )
+				offset[m] = offset[m-1] + count[m-1];
+			omp_target_memcpy(count_d, offset, n_mats*sizeof(long), 0, 0, device, host_device);
+
+			// Bucket the batch by material
+			#pragma omp target teams distribute parallel for is_device_ptr(mat_d, queue_d, count_d) device(device)
+			for( long j = 0; j < n; j++ )
+			{
+				long pos;
+				#pragma omp atomic capture
+				pos = count_d[mat_d[j]]++;
+				queue_d[pos] = j;
+			}
+
+			// Run the lookups in material order
+			#pragma omp target teams distribute parallel for reduction(+:validation_hash_k) \
+					map(to:data.n_windows[:0], data.poles[:0], data.windows[:0], data.curvefit[:0], data.pseudo_K0RS[:0]) \
+					map(to:data.num_nucs[:0], data.mats[:0], data.concs[:0], data.max_num_nucs) \
+					map(to:data.pole_offsets[:0], data.window_offsets[:0], data.faddeeva_table[:0], data.dopp[:0]) \
+					map(tofrom:validation_hash_k) \
+					is_device_ptr(energy_d, mat_d, queue_d) \
+					device(device)
+			for( long q = 0; q < n; q++ )
+			{
+				int j = queue_d[q];
+				double E = energy_d[j];
+				int mat  = mat_d[j];
+
+				double macro_xs[4];
+				calculate_macro_xs_hoisted( macro_xs, mat, E, input, data.num_nucs, data.mats, data.max_num_nucs,
+				                            data.concs, data.n_windows, data.pseudo_K0RS, data.windows, data.poles,
+				                            data.window_offsets, data.pole_offsets, data.curvefit, data.faddeeva_table, data.dopp );
+
+				// For verification, and to prevent the compiler from optimizing
+				// all work out, we interrogate the returned macro_xs_vector array
+				// to find its maximum value index, then increment the verification
+				// value by that index.
+				double max = -DBL_MAX;
+				int max_idx = 0;
+				for(int x = 0; x < 4; x++ )
+				{
+					if( macro_xs[x] > max )
+					{
+						max = macro_xs[x];
+						max_idx = x;
+					}
+				}
+				validation_hash_k += max_idx+1;
+			}
+		}
+
+		omp_target_free(energy_d, device);
+		omp_target_free(mat_d, device);
+		omp_target_free(queue_d, device);
+		omp_target_free(count_d, device);
+
+		validation_hash += validation_hash_k;
+	}
+
+	// Print if kernel actually ran on the device
+	if( !on_host )
+		printf( "Kernel ran accelerator device.\n" );
+	else
+		printf( "NOTE - Kernel ran on the host!\n" );
+
+	*vhash_result = validation_hash;
+}
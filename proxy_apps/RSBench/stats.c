@@ -0,0 +1,72 @@
+#include "rsbench.h"
+
+////////////////////////////////////////////////////////////////////////////////////
+// FADDEEVA BRANCH STATISTICS
+////////////////////////////////////////////////////////////////////////////////////
+// The cost of a Doppler broadened lookup depends on how many of its poles fall
+// in the |Z| < 6 region of the Faddeeva function, where the default evaluator
+// runs the Abrarov series (and the table evaluator interpolates) instead of
+// the cheap asymptotic expansion. This samples lookups on the host like the
+// event based simulation does, and counts the branch taken by every pole of
+// every lookup, per material. These are sampled statistics from a separate
+// pass after the timed run, not counters from the timed kernels.
+////////////////////////////////////////////////////////////////////////////////////
+
+void print_faddeeva_branch_stats( SimulationData SD )
+{
+	int n_mats = SD.length_num_nucs;
+	unsigned long long lookups[n_mats];
+	unsigned long long poles[n_mats];
+	unsigned long long core[n_mats];
+	for( int m = 0; m < n_mats; m++ )
+	{
+		lookups[m] = 0;
+		poles[m] = 0;
+		core[m] = 0;
+	}
+
+	for( unsigned long i = 0; i < BRANCH_STATS_LOOKUPS; i++ )
+	{
+		// Sample exactly like the event based kernel does
+		uint64_t seed = fast_forward_LCG(STARTING_SEED, 2*i);
+		double E = LCG_random_double(&seed);
+		int mat  = pick_mat(&seed);
+		double dopp = SD.dopp[mat];
+
+		lookups[mat]++;
+		for( int k = 0; k < SD.num_nucs[mat]; k++ )
+		{
+			int nuc = SD.mats[mat * SD.max_num_nucs + k];
+
+			// Window of the lookup, as in calculate_micro_xs_doppler
+			double spacing = 1.0 / SD.n_windows[nuc];
+			int window = (int) ( E / spacing );
+			if( window == SD.n_windows[nuc] )
+				window--;
+			Window w = SD.windows[SD.window_offsets[nuc] + window];
+
+			for( int p = w.start; p < w.end; p++ )
+			{
+				Pole pole = SD.poles[SD.pole_offsets[nuc] + p];
+				RSComplex Z = {(E - pole.MP_EA.r) * dopp, -pole.MP_EA.i * dopp};
+				poles[mat]++;
+				if( c_abs(Z) < 6.0 )
+					core[mat]++;
+			}
+		}
+	}
+
+	printf("Faddeeva branches per material (sampled in a separate host pass of %d lookups, not counted in the timed run):\n", BRANCH_STATS_LOOKUPS);
+	printf("  Material  Temp (K)     dopp    Lookups  Poles/Lookup  |Z| < 6 (%%)\n");
+	unsigned long long total_lookups = 0, total_poles = 0, total_core = 0;
+	for( int m = 0; m < n_mats; m++ )
+	{
+		printf("  %8d  %8.1lf  %7.4lf  %9llu  %12.2lf  %11.3lf\n", m, SD.temperatures[m], SD.dopp[m], lookups[m],
+		       lookups[m] ? (double) poles[m] / lookups[m] : 0.0, poles[m] ? 100.0 * core[m] / poles[m] : 0.0);
+		total_lookups += lookups[m];
+		total_poles += poles[m];
+		total_core += core[m];
+	}
+	printf("  %8s  %8s  %7s  %9llu  %12.2lf  %11.3lf\n", "All", "", "", total_lookups,
+	       (double) total_poles / total_lookups, total_poles ? 100.0 * total_core / total_poles : 0.0);
+}
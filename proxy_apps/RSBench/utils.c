@@ -2,12 +2,24 @@
 
 size_t get_mem_estimate( Input input )
 {
-	size_t poles = input.n_nuclides * input.avg_n_poles * sizeof(Pole) + input.n_nuclides * sizeof(Pole *);
-	size_t windows = input.n_nuclides * input.avg_n_windows * sizeof(Window) + input.n_nuclides * sizeof(Window *);
+	// Poles and windows are stored back to back (CSR), so their total
+	// counts are exactly n_nuclides times the averages
+	size_t poles = input.n_nuclides * input.avg_n_poles * sizeof(Pole) + (input.n_nuclides + 1) * sizeof(int);
+	size_t windows = input.n_nuclides * input.avg_n_windows * sizeof(Window) + (input.n_nuclides + 1) * sizeof(int);
 	size_t pseudo_K0RS = input.n_nuclides * input.numL * sizeof( double ) + input.n_nuclides * sizeof(double);
 	size_t other = input.n_nuclides * 2 * sizeof(int);
+	size_t poles_soa = 0;
+	if( input.pole_layout == POLES_SOA )
+		poles_soa = input.n_nuclides * input.avg_n_poles * ( POLE_SOA_COMPONENTS * sizeof(double) + sizeof(short) );
+	size_t faddeeva_table = 0;
+	if( input.doppler == 1 && input.faddeeva == FADDEEVA_TABLE )
+		faddeeva_table = FADDEEVA_TABLE_NX * FADDEEVA_TABLE_NY * sizeof(RSComplex);
 
-	size_t total = poles + windows + pseudo_K0RS + other;
+	size_t curvefit = (size_t) input.n_nuclides * input.avg_n_windows * ( input.fit_order + 1 ) * CURVEFIT_CHANNELS * sizeof(double);
+	if( input.fit_order == 0 )
+		curvefit = 0;
+
+	size_t total = poles + windows + pseudo_K0RS + other + poles_soa + faddeeva_table + curvefit;
 	
 	return total;
 }
@@ -0,0 +1,229 @@
+#include "XSbench_header.h"
+
+////////////////////////////////////////////////////////////////////////////////////
+// BATCH LOOKUPS (HOST)
+////////////////////////////////////////////////////////////////////////////////////
+// Transport codes with many tallies often need the macroscopic XS of several
+// materials at the same energy. Looking the materials up one at a time
+// recomputes the micro XS of every nuclide they share (the water nuclides 24,
+// 41, 4 and 5, the structural nuclides of the reflectors and plates, ...)
+// once per material. calculate_macro_xs_batch looks each distinct nuclide up
+// only once, and scatters its micro XS into all the materials containing it.
+//
+// This mode runs the event based lookups on the host with each energy
+// evaluated against a batch of materials: the sampled material, followed by
+// the next batch_mats - 1 materials (cyclically). The batches are first
+// looked up one material at a time with calculate_macro_xs, then with
+// calculate_macro_xs_batch, and the lookups/s are compared. The verification
+// hash is that of the sampled materials, so it matches the event based
+// simulation.
+//
+// Sharing saves the most lookups when the fuel is not in the batch, or is
+// small (H-M small: 197 micro XS per lookup become 68 with -M 12, but only
+// 484 become 355 in H-M large). On H-M large, the batch has only been faster
+// with the hash grid: on the unionized and nuclide grids, the scatter costs
+// about as much as the lookups it saves.
+////////////////////////////////////////////////////////////////////////////////////
+
+// Calculates the macroscopic cross sections of "n_batch" materials
+// (batch_mats) at the same energy, storing those of batch_mats[b] in
+// macro_xs_vectors[5*b .. 5*b+4]. Many nuclides appear in several materials
+// (e.g., 24, 41, 4 and 5 are in every water bearing material), so instead of
+// looking each material up in turn, the distinct nuclides of the batch are
+// looked up once each, and every micro XS is scattered into the macro XS of
+// all batch materials that contain the nuclide, using the nuclide to material
+// incidence structure (see load_nuc_mats). The terms of each macro XS are
+// summed in a different order than by calculate_macro_xs, so the results can
+// differ from it in the last bits.
+static void calculate_macro_xs_batch( double p_energy, int n_batch, int * batch_mats, long n_isotopes,
+                                      long n_gridpoints, int *  num_nucs, int *  mats,
+                                      int *  nuc_mat_offsets, int *  nuc_mat_mats, double *  nuc_mat_concs,
+                                      double *  egrid, int *  index_data,
+                                      NuclideGridPoint *  nuclide_grids,
+                                      double *  macro_xs_vectors, int grid_type, int hash_bins, int max_num_nucs ){
+	// Position of each material in the batch (-1 if not in it). A material
+	// listed more than once is computed at its last position.
+	int slot[N_MATERIALS];
+	for( int m = 0; m < N_MATERIALS; m++ )
+		slot[m] = -1;
+	for( int b = 0; b < n_batch; b++ )
+	{
+		assert( batch_mats[b] >= 0 && batch_mats[b] < N_MATERIALS );
+		slot[batch_mats[b]] = b;
+		for( int k = 0; k < 5; k++ )
+			macro_xs_vectors[b*5 + k] = 0;
+	}
+
+	// Distinct nuclides of the batch
+	uint64_t done[(n_isotopes + 63) / 64];
+	memset( done, 0, sizeof(done) );
+	int nucs[n_isotopes];
+	int n_nucs = 0;
+	for( int b = 0; b < n_batch; b++ )
+	{
+		int mat = batch_mats[b];
+		if( slot[mat] != b )
+			continue;
+		for( int j = 0; j < num_nucs[mat]; j++ )
+		{
+			int p_nuc = mats[mat*max_num_nucs + j];
+			if( !( done[p_nuc / 64] & ( 1ULL << (p_nuc % 64) ) ) )
+				nucs[n_nucs++] = p_nuc;
+			done[p_nuc / 64] |= 1ULL << (p_nuc % 64);
+		}
+	}
+
+	long idx = calculate_grid_index( p_energy, n_isotopes, n_gridpoints, egrid, grid_type, hash_bins );
+
+	// The micro XS are all looked up before any is scattered. The lookups are
+	// independent, so the processor overlaps their cache misses, as it does
+	// for the nuclides of calculate_macro_xs (interleaving the scatter, with
+	// its data dependent branches, serializes them).
+	double xs_vectors[n_nucs][5];
+	calculate_micro_xs_nucs( p_energy, n_nucs, nucs, n_isotopes,
+	                         n_gridpoints, egrid, index_data,
+	                         nuclide_grids, idx, &xs_vectors[0][0], grid_type, hash_bins );
+
+	// Scatter each micro XS into every batch material containing the nuclide
+	for( int n = 0; n < n_nucs; n++ )
+		for( int e = nuc_mat_offsets[nucs[n]]; e < nuc_mat_offsets[nucs[n] + 1]; e++ )
+		{
+			int s = slot[nuc_mat_mats[e]];
+			if( s < 0 )
+				continue;
+			for( int k = 0; k < 5; k++ )
+				macro_xs_vectors[s*5 + k] += xs_vectors[n][k] * nuc_mat_concs[e];
+		}
+
+	// Copies of materials listed more than once
+	for( int b = 0; b < n_batch; b++ )
+	{
+		int s = slot[batch_mats[b]];
+		if( s != b )
+			for( int k = 0; k < 5; k++ )
+				macro_xs_vectors[b*5 + k] = macro_xs_vectors[s*5 + k];
+	}
+}
+
+// Samples the energy and the batch of materials of lookup i
+static void batch_sample( unsigned long i, int batch_mats, double * p_energy, int * mats )
+{
+	// Sample exactly like the event based kernel does
+	uint64_t seed = fast_forward_LCG(STARTING_SEED, 2*i);
+	*p_energy = LCG_random_double(&seed);
+	int mat   = pick_mat(&seed);
+
+	for( int b = 0; b < batch_mats; b++ )
+		mats[b] = ( mat + b ) % N_MATERIALS;
+}
+
+// Looks up the batch of lookup i, one material at a time or as a batch
+static void batch_lookup( Inputs in, SimulationData SD, double p_energy, int * mats, int use_batch, double * macro_xs_vectors )
+{
+	if( use_batch )
+		calculate_macro_xs_batch( p_energy, in.batch_mats, mats, in.n_isotopes, in.n_gridpoints,
+		                          SD.num_nucs, SD.mats, SD.nuc_mat_offsets, SD.nuc_mat_mats, SD.nuc_mat_concs,
+		                          SD.unionized_energy_array, SD.index_grid, SD.nuclide_grid,
+		                          macro_xs_vectors, in.grid_type, in.hash_bins, SD.max_num_nucs );
+	else
+		for( int b = 0; b < in.batch_mats; b++ )
+			calculate_macro_xs( p_energy, mats[b], in.n_isotopes, in.n_gridpoints, SD.num_nucs, SD.concs,
+			                    SD.unionized_energy_array, SD.index_grid, SD.nuclide_grid, SD.mats,
+			                    &macro_xs_vectors[b*5], in.grid_type, in.hash_bins, SD.max_num_nucs, NULL );
+}
+
+// Runs all lookups, and returns the verification hash
+static unsigned long long batch_run_lookups( Inputs in, SimulationData SD, int use_batch, double * rate )
+{
+	unsigned long long verification = 0;
+	double start = omp_get_wtime();
+
+	#pragma omp parallel for schedule(static) reduction(+:verification)
+	for( unsigned long i = 0; i < in.lookups; i++ )
+	{
+		double p_energy;
+		int mats[N_MATERIALS];
+		batch_sample( i, in.batch_mats, &p_energy, mats );
+
+		double macro_xs_vectors[N_MATERIALS*5];
+		batch_lookup( in, SD, p_energy, mats, use_batch, macro_xs_vectors );
+
+		// Verification of the sampled material (the first of the batch)
+		double max = -1.0;
+		int max_idx = 0;
+		for(int j = 0; j < 5; j++ )
+		{
+			if( macro_xs_vectors[j] > max )
+			{
+				max = macro_xs_vectors[j];
+				max_idx = j;
+			}
+		}
+		verification += max_idx+1;
+	}
+
+	*rate = in.lookups / ( omp_get_wtime() - start );
+	return verification;
+}
+
+unsigned long long run_batch_simulation(Inputs in, SimulationData SD, int mype)
+{
+	if( mype == 0 )
+		printf("Beginning batch lookup comparison on host...\n");
+
+	double per_material_rate, batch_rate;
+	unsigned long long per_material_verification = batch_run_lookups( in, SD, 0, &per_material_rate );
+	unsigned long long verification = batch_run_lookups( in, SD, 1, &batch_rate );
+
+	// Compares the XS of both methods on a subset of the lookups, and counts
+	// the micro XS lookups each of them does
+	unsigned long n_check = ( in.lookups < BATCH_CHECK_LOOKUPS ) ? in.lookups : BATCH_CHECK_LOOKUPS;
+	double max_diff = 0;
+	unsigned long long per_material_micro = 0, batch_micro = 0;
+	#pragma omp parallel for schedule(static) reduction(max:max_diff) reduction(+:per_material_micro,batch_micro)
+	for( unsigned long i = 0; i < n_check; i++ )
+	{
+		double p_energy;
+		int mats[N_MATERIALS];
+		batch_sample( i, in.batch_mats, &p_energy, mats );
+
+		double ref[N_MATERIALS*5], xs[N_MATERIALS*5];
+		batch_lookup( in, SD, p_energy, mats, 0, ref );
+		batch_lookup( in, SD, p_energy, mats, 1, xs );
+		for( int k = 0; k < in.batch_mats * 5; k++ )
+		{
+			double diff = fabs( xs[k] - ref[k] );
+			if( ref[k] != 0 )
+				diff /= fabs( ref[k] );
+			if( diff > max_diff )
+				max_diff = diff;
+		}
+
+		char seen[in.n_isotopes];
+		memset( seen, 0, in.n_isotopes );
+		for( int b = 0; b < in.batch_mats; b++ )
+			for( int j = 0; j < SD.num_nucs[mats[b]]; j++ )
+			{
+				int nuc = SD.mats[mats[b] * SD.max_num_nucs + j];
+				per_material_micro++;
+				if( !seen[nuc] )
+					batch_micro++;
+				seen[nuc] = 1;
+			}
+	}
+
+	if( mype == 0 )
+	{
+		printf("Materials per Lookup:         %d\n", in.batch_mats);
+		printf("Micro XS per Lookup:          %.2lf (per material), %.2lf (batch)\n",
+		       (double) per_material_micro / n_check, (double) batch_micro / n_check);
+		printf("Per Material Lookups/s:       "); fancy_int(per_material_rate);
+		printf("Batch Lookups/s:              "); fancy_int(batch_rate);
+		printf("Batch/Per Material:           %.3lf\n", batch_rate / per_material_rate);
+		printf("Max Relative XS Difference:   %.3e\n", max_diff);
+		if( verification != per_material_verification )
+			printf("Warning: batch and per material lookups gave different verification hashes!\n");
+	}
+
+	return verification;
+}
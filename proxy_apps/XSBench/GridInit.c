@@ -1,5 +1,177 @@
 #include "XSbench_header.h"
 
+// Number of unionized energies per parallel work item when filling the
+// unionized index grid
+#define UEG_BLOCK_SIZE 4096
+
+// Returns the number of energies in a sorted nuclide grid that are strictly
+// less than (upper == 0) or less than or equal to (upper == 1) the quarry
+static long count_energies_below( long n, double quarry, NuclideGridPoint * A, int upper )
+{
+	long lowerLimit = 0;
+	long upperLimit = n;
+
+	while( lowerLimit < upperLimit )
+	{
+		long examinationPoint = lowerLimit + ( upperLimit - lowerLimit ) / 2;
+
+		if( A[examinationPoint].energy < quarry || ( upper && A[examinationPoint].energy == quarry ) )
+			lowerLimit = examinationPoint + 1;
+		else
+			upperLimit = examinationPoint;
+	}
+
+	return lowerLimit;
+}
+
+// Merges all individually sorted nuclide energy grids into the unionized
+// energy grid. The result is identical to sorting all energies at once: the
+// energy range is partitioned by splitter values, every nuclide grid is cut
+// at the splitters with a binary search, and each partition is merged
+// independently by a binary min-heap over the nuclides.
+static void merge_unionized_energy_grid( Inputs in, NuclideGridPoint * nuclide_grid, double * unionized_energy_array )
+{
+	long n_isotopes = in.n_isotopes;
+	long n_gridpoints = in.n_gridpoints;
+	int n_parts = 4 * omp_get_max_threads();
+
+	// Splitters are taken as the median over all nuclides of the grid point
+	// at each partition's quantile, which keeps partitions well balanced.
+	// The medians are non-decreasing in the partition index, as required.
+	double * splitters = (double *) malloc( (n_parts + 1) * sizeof(double));
+	assert(splitters != NULL);
+	double * samples = (double *) malloc( n_isotopes * sizeof(double));
+	assert(samples != NULL);
+	for( int p = 1; p < n_parts; p++ )
+	{
+		for( long i = 0; i < n_isotopes; i++ )
+			samples[i] = nuclide_grid[i * n_gridpoints + p * n_gridpoints / n_parts].energy;
+		qsort( samples, n_isotopes, sizeof(double), double_compare);
+		splitters[p] = samples[n_isotopes / 2];
+	}
+	free(samples);
+
+	// Cut points: partition p holds grid points [cut[p][i], cut[p+1][i]) of
+	// nuclide i, i.e., all energies in [splitters[p], splitters[p+1])
+	long * cut = (long *) malloc( (n_parts + 1) * n_isotopes * sizeof(long));
+	assert(cut != NULL);
+	for( long i = 0; i < n_isotopes; i++ )
+	{
+		cut[i] = 0;
+		cut[n_parts * n_isotopes + i] = n_gridpoints;
+	}
+
+	#pragma omp parallel for collapse(2)
+	for( int p = 1; p < n_parts; p++ )
+		for( long i = 0; i < n_isotopes; i++ )
+			cut[p * n_isotopes + i] = count_energies_below( n_gridpoints, splitters[p], nuclide_grid + i * n_gridpoints, 0 );
+
+	#pragma omp parallel
+	{
+		long * heap = (long *) malloc( n_isotopes * sizeof(long));
+		assert(heap != NULL);
+		long * pos = (long *) malloc( n_isotopes * sizeof(long));
+		assert(pos != NULL);
+		long * end = (long *) malloc( n_isotopes * sizeof(long));
+		assert(end != NULL);
+
+		#pragma omp for schedule(dynamic)
+		for( int p = 0; p < n_parts; p++ )
+		{
+			// Output offset and heap of non-empty nuclide ranges for this partition
+			long out = 0;
+			long heap_size = 0;
+			for( long i = 0; i < n_isotopes; i++ )
+			{
+				pos[i] = i * n_gridpoints + cut[p * n_isotopes + i];
+				end[i] = i * n_gridpoints + cut[(p+1) * n_isotopes + i];
+				out += cut[p * n_isotopes + i];
+
+				if( pos[i] == end[i] )
+					continue;
+
+				// Sift up
+				long c = heap_size++;
+				while( c > 0 && nuclide_grid[pos[heap[(c-1)/2]]].energy > nuclide_grid[pos[i]].energy )
+				{
+					heap[c] = heap[(c-1)/2];
+					c = (c-1)/2;
+				}
+				heap[c] = i;
+			}
+
+			while( heap_size > 0 )
+			{
+				long i = heap[0];
+				unionized_energy_array[out++] = nuclide_grid[pos[i]].energy;
+
+				// Advance the top nuclide, or drop it once exhausted
+				if( ++pos[i] == end[i] )
+					i = heap[--heap_size];
+				if( heap_size == 0 )
+					break;
+
+				// Sift down
+				double e = nuclide_grid[pos[i]].energy;
+				long c = 0;
+				while( 2*c + 1 < heap_size )
+				{
+					long child = 2*c + 1;
+					if( child + 1 < heap_size && nuclide_grid[pos[heap[child+1]]].energy < nuclide_grid[pos[heap[child]]].energy )
+						child++;
+					if( nuclide_grid[pos[heap[child]]].energy >= e )
+						break;
+					heap[c] = heap[child];
+					c = child;
+				}
+				heap[c] = i;
+			}
+		}
+
+		free(heap);
+		free(pos);
+		free(end);
+	}
+
+	free(cut);
+	free(splitters);
+}
+
+// Reconstructs, for a single nuclide, the value of idx_low that the serial
+// unionized index grid sweep holds after processing unionized energy e.
+// The sweep advances idx_low by at most one per unionized energy, and only
+// lags behind the nuclide grid inside a run of equal energies. The lag is
+// therefore recovered from the position of e within its run.
+static int index_grid_sweep_state( long n_gridpoints, NuclideGridPoint * A, double * unionized_energy_array, long e )
+{
+	double energy = unionized_energy_array[e];
+
+	// Number of gridpoints (excluding the first) at or below this energy,
+	// and how many of those are exactly equal to it
+	long target = count_energies_below( n_gridpoints - 1, energy, A + 1, 1 );
+	long ties   = target - count_energies_below( n_gridpoints - 1, energy, A + 1, 0 );
+
+	// Position of e within its run of equal unionized energies
+	long lowerLimit = 0;
+	long upperLimit = e;
+	while( lowerLimit < upperLimit )
+	{
+		long examinationPoint = lowerLimit + ( upperLimit - lowerLimit ) / 2;
+		if( unionized_energy_array[examinationPoint] < energy )
+			lowerLimit = examinationPoint + 1;
+		else
+			upperLimit = examinationPoint;
+	}
+	long rank = e - lowerLimit;
+
+	if( ties > rank + 1 )
+		target -= ties - (rank + 1);
+	if( target > n_gridpoints - 2 )
+		target = n_gridpoints - 2;
+
+	return target;
+}
+
 SimulationData grid_init_do_not_profile( Inputs in, int mype )
 {
 	// Structure to hold all allocated simuluation data arrays
@@ -9,7 +181,7 @@ SimulationData grid_init_do_not_profile( Inputs in, int mype )
 	size_t nbytes = 0;
 
 	// Set the initial seed value
-	uint64_t seed = 42;	
+	uint64_t seed = GRID_SEED;
 
 	////////////////////////////////////////////////////////////////////
 	// Initialize Nuclide Grids
@@ -30,22 +202,46 @@ SimulationData grid_init_do_not_profile( Inputs in, int mype )
 	
 	// Initialize Nuclide Grid
 	SD.length_nuclide_grid = in.n_isotopes * in.n_gridpoints;
-	SD.nuclide_grid     = (NuclideGridPoint *) malloc( SD.length_nuclide_grid * sizeof(NuclideGridPoint));
+	// In streaming mode, the grid lives in a memory-mapped file instead, so
+	// that it does not need to fit in memory.
+	if( in.stream_batch > 0 )
+		SD.nuclide_grid = (NuclideGridPoint *) stream_map_grid( in, SD.length_nuclide_grid * sizeof(NuclideGridPoint));
+	else
+		SD.nuclide_grid = (NuclideGridPoint *) malloc( SD.length_nuclide_grid * sizeof(NuclideGridPoint));
 	assert(SD.nuclide_grid != NULL);
 	nbytes += SD.length_nuclide_grid * sizeof(NuclideGridPoint);
-	for( int i = 0; i < SD.length_nuclide_grid; i++ )
+
+	// Each nuclide is generated and sorted independently. Every gridpoint
+	// draws 6 samples from the LCG stream, so each nuclide fast forwards the
+	// stream to its first gridpoint, which produces exactly the same data as
+	// a single sequential pass over the whole grid.
+	#pragma omp parallel
 	{
-		SD.nuclide_grid[i].energy        = LCG_random_double(&seed);
-		SD.nuclide_grid[i].total_xs      = LCG_random_double(&seed);
-		SD.nuclide_grid[i].elastic_xs    = LCG_random_double(&seed);
-		SD.nuclide_grid[i].absorbtion_xs = LCG_random_double(&seed);
-		SD.nuclide_grid[i].fission_xs    = LCG_random_double(&seed);
-		SD.nuclide_grid[i].nu_fission_xs = LCG_random_double(&seed);
-	}
+		NuclideGridPoint * scratch = (NuclideGridPoint *) malloc( in.n_gridpoints * sizeof(NuclideGridPoint));
+		assert(scratch != NULL);
 
-	// Sort so that each nuclide has data stored in ascending energy order.
-	for( int i = 0; i < in.n_isotopes; i++ )
-		qsort( &SD.nuclide_grid[i*in.n_gridpoints], in.n_gridpoints, sizeof(NuclideGridPoint), NGP_compare);
+		#pragma omp for schedule(static)
+		for( long n = 0; n < in.n_isotopes; n++ )
+		{
+			uint64_t nuclide_seed = fast_forward_LCG(seed, 6 * n * in.n_gridpoints);
+			NuclideGridPoint * grid = &SD.nuclide_grid[n * in.n_gridpoints];
+
+			for( long i = 0; i < in.n_gridpoints; i++ )
+			{
+				grid[i].energy        = LCG_random_double(&nuclide_seed);
+				grid[i].total_xs      = LCG_random_double(&nuclide_seed);
+				grid[i].elastic_xs    = LCG_random_double(&nuclide_seed);
+				grid[i].absorbtion_xs = LCG_random_double(&nuclide_seed);
+				grid[i].fission_xs    = LCG_random_double(&nuclide_seed);
+				grid[i].nu_fission_xs = LCG_random_double(&nuclide_seed);
+			}
+
+			// Sort so that each nuclide has data stored in ascending energy order.
+			sort_nuclide_grid( grid, in.n_gridpoints, scratch );
+		}
+
+		free(scratch);
+	}
 	
 	// error debug check
 	/*
@@ -66,6 +262,42 @@ SimulationData grid_init_do_not_profile( Inputs in, int mype )
 	{
 		SD.length_unionized_energy_array = 0;
 		SD.length_index_grid = 0;
+
+		// If requested, build a logarithmic grid for each nuclide, which
+		// holds the lower bounding gridpoint of each log spaced energy. It
+		// limits each nuclide grid search to the gridpoints of one log bin,
+		// at a small fraction of the memory of the unionized grid.
+		if( in.hash_bins > 0 )
+		{
+			if(mype == 0) printf("Intializing nuclide log grids...\n");
+			long n_bounds = in.hash_bins + 1;
+			SD.length_index_grid = in.n_isotopes * n_bounds;
+			SD.index_grid = (int *) malloc( SD.length_index_grid * sizeof(int));
+			assert(SD.index_grid != NULL);
+			nbytes += SD.length_index_grid * sizeof(int);
+
+			double spacing = log(1.0 / LOG_GRID_E_MIN) / in.hash_bins;
+
+			#pragma omp parallel for
+			for( long i = 0; i < in.n_isotopes; i++ )
+			{
+				NuclideGridPoint * grid = SD.nuclide_grid + i * in.n_gridpoints;
+
+				// Bin boundaries are increasing, so each search can start
+				// from where the previous one ended
+				long low = 0;
+				for( long b = 0; b < n_bounds; b++ )
+				{
+					double energy = LOG_GRID_E_MIN * exp(b * spacing);
+					low = grid_search_nuclide( in.n_gridpoints, energy, grid, low, in.n_gridpoints-1);
+					SD.index_grid[i * n_bounds + b] = low;
+				}
+			}
+
+			if(mype == 0) printf("Nuclide log grids use %.1lf MB (%.1lf%% of the nuclide grids).\n",
+			                     SD.length_index_grid * sizeof(int) / 1024.0 / 1024.0,
+			                     100.0 * SD.length_index_grid * sizeof(int) / ( SD.length_nuclide_grid * sizeof(NuclideGridPoint) ));
+		}
 	}
 	
 	if( in.grid_type == UNIONIZED )
@@ -78,12 +310,11 @@ SimulationData grid_init_do_not_profile( Inputs in, int mype )
 		assert(SD.unionized_energy_array != NULL );
 		nbytes += SD.length_unionized_energy_array * sizeof(double);
 
-		// Copy energy data over from the nuclide energy grid
-		for( int i = 0; i < SD.length_unionized_energy_array; i++ )
-			SD.unionized_energy_array[i] = SD.nuclide_grid[i].energy;
-
-		// Sort unionized energy array
-		qsort( SD.unionized_energy_array, SD.length_unionized_energy_array, sizeof(double), double_compare);
+		// Each nuclide grid is already sorted, so the unionized grid is
+		// built by a k-way merge of all nuclide grids rather than by
+		// sorting it from scratch. The merge is split into independent
+		// energy ranges that are merged in parallel.
+		merge_unionized_energy_grid( in, SD.nuclide_grid, SD.unionized_energy_array );
 
 		// Allocate space to hold the acceleration grid indices
 		SD.length_index_grid = SD.length_unionized_energy_array * in.n_isotopes;
@@ -91,35 +322,60 @@ SimulationData grid_init_do_not_profile( Inputs in, int mype )
 		assert(SD.index_grid != NULL);
 		nbytes += SD.length_index_grid * sizeof(int);
 
-		// Generates the double indexing grid
-		int * idx_low = (int *) calloc( in.n_isotopes, sizeof(int));
-		assert(idx_low != NULL );
-		double * energy_high = (double *) malloc( in.n_isotopes * sizeof(double));
-		assert(energy_high != NULL );
-
-		for( int i = 0; i < in.n_isotopes; i++ )
-			energy_high[i] = SD.nuclide_grid[i * in.n_gridpoints + 1].energy;
+		// Generates the double indexing grid. The unionized grid is split
+		// into blocks that are filled in parallel. Each block recovers the
+		// state of the serial sweep at its first energy via a binary search
+		// per nuclide, and then sweeps its own energies exactly like the
+		// serial algorithm would.
+		long n_blocks = ( SD.length_unionized_energy_array + UEG_BLOCK_SIZE - 1 ) / UEG_BLOCK_SIZE;
 
-		for( long e = 0; e < SD.length_unionized_energy_array; e++ )
+		#pragma omp parallel
 		{
-			double unionized_energy = SD.unionized_energy_array[e];
-			for( long i = 0; i < in.n_isotopes; i++ )
+			int * idx_low = (int *) malloc( in.n_isotopes * sizeof(int));
+			assert(idx_low != NULL );
+			double * energy_high = (double *) malloc( in.n_isotopes * sizeof(double));
+			assert(energy_high != NULL );
+
+			#pragma omp for schedule(dynamic)
+			for( long b = 0; b < n_blocks; b++ )
 			{
-				if( unionized_energy < energy_high[i]  )
-					SD.index_grid[e * in.n_isotopes + i] = idx_low[i];
-				else if( idx_low[i] == in.n_gridpoints - 2 )
-					SD.index_grid[e * in.n_isotopes + i] = idx_low[i];
-				else
+				long e_start = b * UEG_BLOCK_SIZE;
+				long e_end   = e_start + UEG_BLOCK_SIZE;
+				if( e_end > SD.length_unionized_energy_array )
+					e_end = SD.length_unionized_energy_array;
+
+				for( long i = 0; i < in.n_isotopes; i++ )
 				{
-					idx_low[i]++;
-					SD.index_grid[e * in.n_isotopes + i] = idx_low[i];
-					energy_high[i] = SD.nuclide_grid[i * in.n_gridpoints + idx_low[i] + 1].energy;	
+					if( e_start == 0 )
+						idx_low[i] = 0;
+					else
+						idx_low[i] = index_grid_sweep_state( in.n_gridpoints, SD.nuclide_grid + i * in.n_gridpoints,
+						                                     SD.unionized_energy_array, e_start - 1 );
+					energy_high[i] = SD.nuclide_grid[i * in.n_gridpoints + idx_low[i] + 1].energy;
+				}
+
+				for( long e = e_start; e < e_end; e++ )
+				{
+					double unionized_energy = SD.unionized_energy_array[e];
+					for( long i = 0; i < in.n_isotopes; i++ )
+					{
+						if( unionized_energy < energy_high[i]  )
+							SD.index_grid[e * in.n_isotopes + i] = idx_low[i];
+						else if( idx_low[i] == in.n_gridpoints - 2 )
+							SD.index_grid[e * in.n_isotopes + i] = idx_low[i];
+						else
+						{
+							idx_low[i]++;
+							SD.index_grid[e * in.n_isotopes + i] = idx_low[i];
+							energy_high[i] = SD.nuclide_grid[i * in.n_gridpoints + idx_low[i] + 1].energy;	
+						}
+					}
 				}
 			}
-		}
 
-		free(idx_low);
-		free(energy_high);
+			free(idx_low);
+			free(energy_high);
+		}
 	}
 
 	if( in.grid_type == HASH )
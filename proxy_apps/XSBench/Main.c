@@ -41,9 +41,13 @@ int main( int argc, char* argv[] )
 	SimulationData SD;
 
 	// If read from file mode is selected, skip initialization and load
-	// all simulation data structures from file instead
+	// all simulation data structures from file instead. In cache mode, the
+	// data is loaded from the dataset cache, or initialized and added to
+	// the cache if it is not there yet.
 	if( in.binary_mode == READ )
 		SD = binary_read(in);
+	else if( in.binary_mode == CACHE )
+		SD = binary_cache_load(in, mype);
 	else
 		SD = grid_init_do_not_profile( in, mype );
 
@@ -52,6 +56,12 @@ int main( int argc, char* argv[] )
 	if( in.binary_mode == WRITE && mype == 0 )
 		binary_write(in, SD);
 
+	// The nuclide to material incidence structure (used by batch lookups) is
+	// derived from the material data, so it is not stored in binary files
+	SD.nuc_mat_offsets = load_nuc_mats( SD.num_nucs, SD.mats, SD.concs, SD.max_num_nucs, in.n_isotopes,
+	                                    &SD.nuc_mat_mats, &SD.nuc_mat_concs, &SD.length_nuc_mat_entries );
+	SD.length_nuc_mat_offsets = in.n_isotopes + 1;
+
 
 	// =====================================================================
 	// Cross Section (XS) Parallel Lookup Simulation
@@ -74,8 +84,20 @@ int main( int argc, char* argv[] )
 	// Run simulation
 	if( in.simulation_method == EVENT_BASED )
 	{
-		if( in.kernel_id == 0 )
+		if( in.stream_batch > 0 )
+			verification = run_stream_simulation(in, SD, mype);
+		else if( in.numa_compare )
+			verification = run_numa_simulation(in, SD, mype);
+		else if( in.batch_mats > 0 )
+			verification = run_batch_simulation(in, SD, mype);
+		else if( in.kernel_id == 0 )
 			verification = run_event_based_simulation(in, SD, mype);
+		else if( in.kernel_id == 1 )
+			verification = run_event_based_simulation_optimization_1(in, SD, mype);
+		else if( in.kernel_id == 2 )
+			verification = run_event_based_simulation_optimization_2(in, SD, mype);
+		else if( in.kernel_id == 3 )
+			verification = run_event_based_simulation_optimization_3(in, SD, mype);
 		else
 		{
 			printf("Error: No kernel ID %d found!\n", in.kernel_id);
@@ -84,8 +106,14 @@ int main( int argc, char* argv[] )
 	}
 	else
 	{
-		printf("History-based simulation not implemented in OpenMP offload code. Instead,\nuse the event-based method with \"-m event\" argument.\n");
-		exit(1);
+		// Kernel 1 is the baseline with nuclide grid search hints
+		if( in.kernel_id == 0 || in.kernel_id == 1 )
+			verification = run_history_based_simulation(in, SD, mype);
+		else
+		{
+			printf("Error: No kernel ID %d found!\n", in.kernel_id);
+			exit(1);
+		}
 	}
 
 	if( mype == 0)	
@@ -97,6 +125,11 @@ int main( int argc, char* argv[] )
 	// End Simulation Timer
 	omp_end = omp_get_wtime();
 
+	// Report the error of the reduced precision XS data
+	#ifdef MIXED_PRECISION
+	print_precision_error( in, SD, mype );
+	#endif
+
 	// =====================================================================
 	// Output Results & Finalize
 	// =====================================================================
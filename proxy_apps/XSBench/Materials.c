@@ -116,3 +116,37 @@ double * load_concs( int * num_nucs, int max_num_nucs )
 	return concs;
 }
 
+
+// Inverts the material compositions into a nuclide to material incidence
+// structure, in CSR form: the materials containing nuclide n are
+// nuc_mat_mats[nuc_mat_offsets[n] .. nuc_mat_offsets[n+1]-1] (in increasing
+// order), with the concentration of the nuclide in each of them in
+// nuc_mat_concs. Returns nuc_mat_offsets (of length n_isotopes + 1).
+int * load_nuc_mats( int * num_nucs, int * mats, double * concs, int max_num_nucs, long n_isotopes,
+                     int ** nuc_mat_mats, double ** nuc_mat_concs, int * length_entries )
+{
+	int * offsets = (int *) calloc( n_isotopes + 1, sizeof(int) );
+
+	// Count the materials of each nuclide, then turn the counts into offsets
+	for( int m = 0; m < N_MATERIALS; m++ )
+		for( int j = 0; j < num_nucs[m]; j++ )
+			offsets[mats[m * max_num_nucs + j] + 1]++;
+	for( long n = 0; n < n_isotopes; n++ )
+		offsets[n + 1] += offsets[n];
+	*length_entries = offsets[n_isotopes];
+
+	*nuc_mat_mats  = (int *) malloc( *length_entries * sizeof(int) );
+	*nuc_mat_concs = (double *) malloc( *length_entries * sizeof(double) );
+	int * next = (int *) malloc( n_isotopes * sizeof(int) );
+	memcpy( next, offsets, n_isotopes * sizeof(int) );
+	for( int m = 0; m < N_MATERIALS; m++ )
+		for( int j = 0; j < num_nucs[m]; j++ )
+		{
+			int e = next[mats[m * max_num_nucs + j]]++;
+			(*nuc_mat_mats)[e]  = m;
+			(*nuc_mat_concs)[e] = concs[m * max_num_nucs + j];
+		}
+	free(next);
+
+	return offsets;
+}
@@ -0,0 +1,229 @@
+#include "XSbench_header.h"
+#include<sys/syscall.h>
+
+////////////////////////////////////////////////////////////////////////////////////
+// NUMA PLACEMENT COMPARISON (HOST)
+////////////////////////////////////////////////////////////////////////////////////
+// On a multi-socket host, the bandwidth a lookup thread sees depends on which
+// NUMA node holds the grid pages it reads. This mode copies the read-only grids
+// with three different placements, and runs the same event based lookups on
+// the host with each of them:
+//
+//   Interleaved: pages are interleaved over all nodes (mbind)
+//   Local:       pages are first touched by the lookup threads, each thread
+//                touching an equal slice of every grid
+//   Replicated:  every node gets its own copy of the grids, first touched by
+//                the threads of that node, and each thread reads the copy of
+//                the node it ran on when the copies were made
+//
+// Threads should be bound (e.g., OMP_PROC_BIND=spread OMP_PLACES=cores) so that
+// they stay on the node they first ran on. Unbound threads still read a fully
+// copied replica, but possibly one of another node.
+////////////////////////////////////////////////////////////////////////////////////
+
+// Maximum number of NUMA nodes considered
+#define NUMA_MAX_NODES 64
+
+// Memory policy for interleaving pages over nodes (see mbind(2))
+#define NUMA_MPOL_INTERLEAVE 3
+
+// Number of NUMA nodes of the host (1 if unknown)
+static int numa_num_nodes(void)
+{
+	int n = 0;
+	char path[64];
+	for( ; n < NUMA_MAX_NODES; n++ )
+	{
+		snprintf(path, sizeof(path), "/sys/devices/system/node/node%d", n);
+		if( access(path, F_OK) != 0 )
+			break;
+	}
+	return n > 0 ? n : 1;
+}
+
+// NUMA node of the CPU the calling thread runs on
+static int numa_current_node( int n_nodes )
+{
+	unsigned cpu, node;
+	if( syscall(SYS_getcpu, &cpu, &node, NULL) != 0 || node >= (unsigned) n_nodes )
+		return 0;
+	return node;
+}
+
+// Allocates memory whose pages are not touched yet
+static void * numa_alloc( size_t bytes )
+{
+	void * p = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if( p == MAP_FAILED )
+	{
+		printf("Error: could not allocate %zu bytes for NUMA placement!\n", bytes);
+		exit(1);
+	}
+	return p;
+}
+
+// Copies the page aligned slice "rank" out of "n" slices of an array
+static void numa_copy_slice( void * dst, void * src, size_t bytes, int rank, int n )
+{
+	size_t page  = sysconf(_SC_PAGESIZE);
+	size_t slice = ( ( bytes + n - 1 ) / n + page - 1 ) / page * page;
+	size_t start = rank * slice;
+	if( start >= bytes )
+		return;
+	size_t len = ( start + slice < bytes ) ? slice : bytes - start;
+	memcpy( (char *) dst + start, (char *) src + start, len );
+}
+
+// Copies the read-only grids of SD into fresh (untouched) memory. Small
+// arrays (materials) are shared, as they stay cache resident.
+static SimulationData numa_alloc_grids( SimulationData SD )
+{
+	SimulationData P = SD;
+	P.nuclide_grid = (NuclideGridPoint *) numa_alloc( SD.length_nuclide_grid * sizeof(NuclideGridPoint));
+	if( SD.length_index_grid > 0 )
+		P.index_grid = (int *) numa_alloc( SD.length_index_grid * sizeof(int));
+	if( SD.length_unionized_energy_array > 0 )
+		P.unionized_energy_array = (double *) numa_alloc( SD.length_unionized_energy_array * sizeof(double));
+	return P;
+}
+
+static void numa_copy_grids( SimulationData P, SimulationData SD, int rank, int n )
+{
+	numa_copy_slice( P.nuclide_grid, SD.nuclide_grid, SD.length_nuclide_grid * sizeof(NuclideGridPoint), rank, n );
+	if( SD.length_index_grid > 0 )
+		numa_copy_slice( P.index_grid, SD.index_grid, SD.length_index_grid * sizeof(int), rank, n );
+	if( SD.length_unionized_energy_array > 0 )
+		numa_copy_slice( P.unionized_energy_array, SD.unionized_energy_array, SD.length_unionized_energy_array * sizeof(double), rank, n );
+}
+
+static void numa_free_grids( SimulationData P )
+{
+	munmap( P.nuclide_grid, P.length_nuclide_grid * sizeof(NuclideGridPoint));
+	if( P.length_index_grid > 0 )
+		munmap( P.index_grid, P.length_index_grid * sizeof(int));
+	if( P.length_unionized_energy_array > 0 )
+		munmap( P.unionized_energy_array, P.length_unionized_energy_array * sizeof(double));
+}
+
+// Interleaves the pages of an (untouched) array over all nodes. Returns 0 on
+// success.
+static int numa_interleave( void * p, size_t bytes, int n_nodes )
+{
+	unsigned long mask = ( n_nodes >= 64 ) ? ~0UL : ( 1UL << n_nodes ) - 1;
+	return syscall(SYS_mbind, p, bytes, NUMA_MPOL_INTERLEAVE, &mask, NUMA_MAX_NODES + 1, 0) != 0;
+}
+
+// Runs all lookups, each thread with the grids of replica[thread_node[thread]]
+// (or of replica[0] if thread_node is NULL), and returns the verification hash
+static unsigned long long numa_run_lookups( Inputs in, SimulationData * replica, int * thread_node, double * rate )
+{
+	unsigned long long verification = 0;
+	double start = omp_get_wtime();
+
+	#pragma omp parallel reduction(+:verification)
+	{
+		SimulationData SD = replica[ thread_node ? thread_node[omp_get_thread_num()] : 0 ];
+
+		#pragma omp for schedule(static)
+		for( unsigned long i = 0; i < in.lookups; i++ )
+		{
+			// Sample exactly like the event based kernel does
+			uint64_t seed = fast_forward_LCG(STARTING_SEED, 2*i);
+			double p_energy = LCG_random_double(&seed);
+			int mat         = pick_mat(&seed);
+
+			double macro_xs_vector[5] = {0};
+			calculate_macro_xs( p_energy, mat, in.n_isotopes, in.n_gridpoints, SD.num_nucs, SD.concs,
+			                    SD.unionized_energy_array, SD.index_grid, SD.nuclide_grid, SD.mats,
+			                    macro_xs_vector, in.grid_type, in.hash_bins, SD.max_num_nucs, NULL );
+
+			double max = -1.0;
+			int max_idx = 0;
+			for(int j = 0; j < 5; j++ )
+			{
+				if( macro_xs_vector[j] > max )
+				{
+					max = macro_xs_vector[j];
+					max_idx = j;
+				}
+			}
+			verification += max_idx+1;
+		}
+	}
+
+	*rate = in.lookups / ( omp_get_wtime() - start );
+	return verification;
+}
+
+unsigned long long run_numa_simulation(Inputs in, SimulationData SD, int mype)
+{
+	if( mype == 0 )
+		printf("Beginning NUMA placement comparison on host...\n");
+
+	int n_nodes = numa_num_nodes();
+	if( mype == 0 )
+		printf("NUMA Nodes:                   %d\n", n_nodes);
+
+	SimulationData replica[NUMA_MAX_NODES];
+	double interleaved_rate, local_rate, replicated_rate;
+
+	// Interleaved placement. The policy is set before the pages are touched.
+	replica[0] = numa_alloc_grids( SD );
+	int err = numa_interleave( replica[0].nuclide_grid, SD.length_nuclide_grid * sizeof(NuclideGridPoint), n_nodes );
+	if( SD.length_index_grid > 0 )
+		err |= numa_interleave( replica[0].index_grid, SD.length_index_grid * sizeof(int), n_nodes );
+	if( SD.length_unionized_energy_array > 0 )
+		err |= numa_interleave( replica[0].unionized_energy_array, SD.length_unionized_energy_array * sizeof(double), n_nodes );
+	if( err && mype == 0 )
+		printf("Warning: could not interleave pages (mbind failed), using the default policy.\n");
+	#pragma omp parallel
+	numa_copy_grids( replica[0], SD, omp_get_thread_num(), omp_get_num_threads() );
+	unsigned long long verification = numa_run_lookups( in, replica, NULL, &interleaved_rate );
+	numa_free_grids( replica[0] );
+
+	// Local (first touch) placement
+	replica[0] = numa_alloc_grids( SD );
+	#pragma omp parallel
+	numa_copy_grids( replica[0], SD, omp_get_thread_num(), omp_get_num_threads() );
+	unsigned long long local_verification = numa_run_lookups( in, replica, NULL, &local_rate );
+	numa_free_grids( replica[0] );
+
+	// Replicated placement. The threads of each node copy that node's
+	// replica, so all of its pages are first touched on the node. Replicas
+	// of nodes without threads are never touched, so they use no memory.
+	// The node of each thread is only looked up here, so that the lookups
+	// read the replica the thread helped copy, even if it has migrated since.
+	if( n_nodes > 1 && omp_get_proc_bind() == omp_proc_bind_false && mype == 0 )
+		printf("Warning: threads are not bound (set OMP_PROC_BIND and OMP_PLACES), replicas may be read from other nodes.\n");
+	int node_threads[NUMA_MAX_NODES] = {0};
+	int * thread_node = (int *) malloc( omp_get_max_threads() * sizeof(int));
+	for( int r = 0; r < n_nodes; r++ )
+		replica[r] = numa_alloc_grids( SD );
+	#pragma omp parallel
+	{
+		int node = numa_current_node(n_nodes);
+		thread_node[omp_get_thread_num()] = node;
+		int rank;
+		#pragma omp atomic capture
+		rank = node_threads[node]++;
+		#pragma omp barrier
+		numa_copy_grids( replica[node], SD, rank, node_threads[node] );
+	}
+	unsigned long long replicated_verification = numa_run_lookups( in, replica, thread_node, &replicated_rate );
+	for( int r = 0; r < n_nodes; r++ )
+		numa_free_grids( replica[r] );
+	free( thread_node );
+
+	if( mype == 0 )
+	{
+		printf("Interleaved Lookups/s:        "); fancy_int(interleaved_rate);
+		printf("Local Lookups/s:              "); fancy_int(local_rate);
+		printf("Replicated Lookups/s:         "); fancy_int(replicated_rate);
+		printf("Replicated/Interleaved:       %.3lf\n", replicated_rate / interleaved_rate);
+		printf("Local/Interleaved:            %.3lf\n", local_rate / interleaved_rate);
+		if( local_verification != verification || replicated_verification != verification )
+			printf("Warning: placements gave different verification hashes!\n");
+	}
+
+	return verification;
+}
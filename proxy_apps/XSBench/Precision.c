@@ -0,0 +1,121 @@
+#include "XSbench_header.h"
+
+////////////////////////////////////////////////////////////////////////////////////
+// PRECISION CHECK
+////////////////////////////////////////////////////////////////////////////////////
+// In mixed precision builds, the XS channels of the nuclide grid are stored as
+// float. To measure the error this introduces, the first lookups of the event
+// based simulation are repeated on the host, and compared against the same
+// lookups computed from double precision XS data. The double precision data is
+// regenerated one nuclide at a time from the grid's LCG stream, so the check
+// never needs a second copy of the whole nuclide grid.
+////////////////////////////////////////////////////////////////////////////////////
+
+// Gridpoint with double precision XS data
+typedef struct{
+	double energy;
+	double xs[5];
+} RefGridPoint;
+
+static int RGP_compare(const void * a, const void * b)
+{
+	double A = ((RefGridPoint *) a)->energy;
+	double B = ((RefGridPoint *) b)->energy;
+
+	if( A > B )
+		return 1;
+	else if( A < B )
+		return -1;
+	else
+		return 0;
+}
+
+void print_precision_error( Inputs in, SimulationData SD, int mype )
+{
+	long n_lookups = ( in.lookups < PRECISION_CHECK_LOOKUPS ) ? in.lookups : PRECISION_CHECK_LOOKUPS;
+	int n_mats = SD.length_num_nucs;
+
+	double * energy   = (double *) malloc( n_lookups * sizeof(double));
+	int    * mat      = (int *)    malloc( n_lookups * sizeof(int));
+	double * mixed_xs = (double *) malloc( n_lookups * 5 * sizeof(double));
+	double * ref_xs   = (double *) calloc( n_lookups * 5, sizeof(double));
+	RefGridPoint * ref_grid = (RefGridPoint *) malloc( in.n_gridpoints * sizeof(RefGridPoint));
+	// Position of each nuclide in the row of each material (or -1)
+	int * slot = (int *) malloc( n_mats * in.n_isotopes * sizeof(int));
+	assert(energy != NULL && mat != NULL && mixed_xs != NULL && ref_xs != NULL && ref_grid != NULL && slot != NULL);
+
+	for( long i = 0; i < n_mats * in.n_isotopes; i++ )
+		slot[i] = -1;
+	for( int m = 0; m < n_mats; m++ )
+		for( int j = 0; j < SD.num_nucs[m]; j++ )
+			slot[m * in.n_isotopes + SD.mats[m * SD.max_num_nucs + j]] = j;
+
+	// Sample the lookups like the event based simulation, and compute them
+	// with the stored (mixed precision) data
+	#pragma omp parallel for
+	for( long i = 0; i < n_lookups; i++ )
+	{
+		uint64_t seed = fast_forward_LCG(STARTING_SEED, 2*i);
+		energy[i] = LCG_random_double(&seed);
+		mat[i]    = pick_mat(&seed);
+
+		calculate_macro_xs( energy[i], mat[i], in.n_isotopes, in.n_gridpoints, SD.num_nucs, SD.concs,
+		                    SD.unionized_energy_array, SD.index_grid, SD.nuclide_grid, SD.mats,
+		                    mixed_xs + i*5, in.grid_type, in.hash_bins, SD.max_num_nucs, NULL );
+	}
+
+	// Accumulate the double precision macro XS one nuclide at a time
+	for( long n = 0; n < in.n_isotopes; n++ )
+	{
+		// Regenerate the nuclide grid exactly like grid_init_do_not_profile
+		uint64_t nuclide_seed = fast_forward_LCG(GRID_SEED, 6 * n * in.n_gridpoints);
+		for( long g = 0; g < in.n_gridpoints; g++ )
+		{
+			ref_grid[g].energy = LCG_random_double(&nuclide_seed);
+			for( int c = 0; c < 5; c++ )
+				ref_grid[g].xs[c] = LCG_random_double(&nuclide_seed);
+		}
+		qsort( ref_grid, in.n_gridpoints, sizeof(RefGridPoint), RGP_compare );
+
+		// Energies are stored in double, so the stored grid gives the same
+		// lower bounding gridpoint as the double precision grid
+		NuclideGridPoint * grid = SD.nuclide_grid + n * in.n_gridpoints;
+
+		#pragma omp parallel for
+		for( long i = 0; i < n_lookups; i++ )
+		{
+			int j = slot[mat[i] * in.n_isotopes + n];
+			if( j < 0 )
+				continue;
+
+			long idx = grid_search_nuclide( in.n_gridpoints, energy[i], grid, 0, in.n_gridpoints-1);
+			if( idx == in.n_gridpoints - 1 )
+				idx--;
+			RefGridPoint * low  = &ref_grid[idx];
+			RefGridPoint * high = &ref_grid[idx + 1];
+
+			double f = (high->energy - energy[i]) / (high->energy - low->energy);
+			double conc = SD.concs[mat[i] * SD.max_num_nucs + j];
+			for( int c = 0; c < 5; c++ )
+				ref_xs[i*5 + c] += ( high->xs[c] - f * (high->xs[c] - low->xs[c]) ) * conc;
+		}
+	}
+
+	double max_error = 0;
+	for( long i = 0; i < n_lookups * 5; i++ )
+	{
+		double error = fabs( mixed_xs[i] - ref_xs[i] ) / fabs( ref_xs[i] );
+		if( error > max_error )
+			max_error = error;
+	}
+
+	if( mype == 0 )
+		printf("Max relative error of macro XS vs. double (%ld lookups): %.3e\n", n_lookups, max_error);
+
+	free(energy);
+	free(mat);
+	free(mixed_xs);
+	free(ref_xs);
+	free(ref_grid);
+	free(slot);
+}
@@ -287,7 +287,8 @@ unsigned long long run_event_based_simulation(Inputs in, SimulationData SD, int
 				macro_xs_vector, // 1-D array with result of the macroscopic cross section (5 different reaction channels)
 				in.grid_type,    // Lookup type (nuclide, hash, or unionized)
 				in.hash_bins,    // Number of hash bins used (if using hash lookup type)
-				max_num_nucs     // Maximum number of nuclides present in any material
+				max_num_nucs,    // Maximum number of nuclides present in any material
+				NULL             // No search hints
 			);
 
 			// For verification, and to prevent the compiler from optimizing
@@ -321,22 +322,206 @@ unsigned long long run_event_based_simulation(Inputs in, SimulationData SD, int
 	return 0;
 }
 
-// Calculates the microscopic cross section for a given nuclide & energy
-void calculate_micro_xs(   double p_energy, int nuc, long n_isotopes,
+unsigned long long run_history_based_simulation(Inputs in, SimulationData SD, int mype)
+{
+	if( mype == 0)	
+		printf("Beginning history based simulation...\n");
+
+	////////////////////////////////////////////////////////////////////////////////
+	// Each particle is handled by a single thread, which performs all of its
+	// lookups in sequence. The energy and material of each lookup are sampled
+	// from a seed that depends on the results of the previous lookup, so the
+	// lookups of a particle cannot be reordered. By default, each energy is
+	// sampled anew, as in the reference checksums. With correlated energies,
+	// each collision instead slows the particle down from its previous energy,
+	// and the particle stays in the same material for most collisions. Every device
+	// runs all particles, as in the event based simulation, so the hash of the
+	// first device is returned.
+	// If no devices are available, the target region is run on the host
+	// (i.e., the initial device) instead.
+	//
+	// Kernel 1 additionally keeps per-particle nuclide grid search hints, so
+	// that nuclide grid searches start from the index the previous search of
+	// the same nuclide found. This pays off when consecutive energies of a
+	// particle are close, i.e., with correlated energies (-e correlated). With
+	// independent energies the hints rarely hit, so they are not the default.
+	////////////////////////////////////////////////////////////////////////////////
+	int use_hints = ( in.kernel_id == 1 && in.grid_type == NUCLIDE );
+	int num_devices = omp_get_num_devices();
+	int on_host = ( num_devices == 0 );
+	if( on_host )
+		num_devices = 1;
+	unsigned long chunk = in.particles;
+
+	printf("Num Devices: %d\nChunk Size: %lu\n", on_host ? 0 : num_devices, chunk);
+
+	unsigned long long verification = 0;
+
+	#pragma omp parallel for num_threads(num_devices)
+	for (int K = 0; K < num_devices; K++) {
+		int device = on_host ? omp_get_initial_device() : K;
+		unsigned long first = 0;
+		unsigned long last  = chunk;
+		unsigned long long verification_k = 0;
+
+		#pragma omp target teams distribute parallel for reduction(+:verification_k) \
+				map(to: SD.max_num_nucs) \
+				map(to: SD.num_nucs[:SD.length_num_nucs]) \
+				map(to: SD.concs[:SD.length_concs]) \
+				map(to: SD.mats[:SD.length_mats]) \
+				map(to: SD.unionized_energy_array[:SD.length_unionized_energy_array]) \
+				map(to: SD.index_grid[:SD.length_index_grid]) \
+				map(to: SD.nuclide_grid[:SD.length_nuclide_grid]) \
+				map(tofrom: verification_k) \
+		        device(device)
+		for( unsigned long p = first; p < last; p++ )
+		{
+			// Set the initial seed value
+			uint64_t seed = STARTING_SEED;	
+
+			// Forward seed to particle index (we need up to 4 samples per lookup,
+			// and leave room for up to 5 extra samples per lookup skipped below)
+			seed = fast_forward_LCG(seed, p * in.lookups * 2 * 5);
+
+			// Randomly pick an energy and material for the particle
+			double p_energy = LCG_random_double(&seed);
+			int mat         = pick_mat(&seed); 
+
+			// Index found by the last nuclide grid search of each nuclide, from
+			// which the next search of that nuclide starts (-1 if none yet)
+			int hints[NUCLIDE_HINT_SLOTS];
+			if( use_hints )
+				for( int j = 0; j < NUCLIDE_HINT_SLOTS; j++ )
+					hints[j] = -1;
+
+			for( unsigned long i = 0; i < in.lookups; i++ )
+			{
+				double macro_xs_vector[5] = {0};
+
+				// Perform macroscopic Cross Section Lookup
+				calculate_macro_xs(
+					p_energy,        // Sampled neutron energy (in lethargy)
+					mat,             // Sampled material type index neutron is in
+					in.n_isotopes,   // Total number of isotopes in simulation
+					in.n_gridpoints, // Number of gridpoints per isotope in simulation
+					SD.num_nucs,     // 1-D array with number of nuclides per material
+					SD.concs,        // Flattened 2-D array with concentration of each nuclide in each material
+					SD.unionized_energy_array, // 1-D Unionized energy array
+					SD.index_grid,   // Flattened 2-D grid holding indices into nuclide grid for each unionized energy level
+					SD.nuclide_grid, // Flattened 2-D grid holding energy levels and XS_data for all nuclides in simulation
+					SD.mats,         // Flattened 2-D array with nuclide indices defining composition of each type of material
+					macro_xs_vector, // 1-D array with result of the macroscopic cross section (5 different reaction channels)
+					in.grid_type,    // Lookup type (nuclide, hash, or unionized)
+					in.hash_bins,    // Number of hash bins used (if using hash lookup type)
+					SD.max_num_nucs, // Maximum number of nuclides present in any material
+					use_hints ? hints : NULL // Per-nuclide search hints of this particle
+				);
+
+				// For verification, and to prevent the compiler from optimizing
+				// all work out, we interrogate the returned macro_xs_vector array
+				// to find its maximum value index, then increment the verification
+				// value by that index.
+				double max = -1.0;
+				int max_idx = 0;
+				for(int j = 0; j < 5; j++ )
+				{
+					if( macro_xs_vector[j] > max )
+					{
+						max = macro_xs_vector[j];
+						max_idx = j;
+					}
+				}
+				verification_k += max_idx+1;
+
+				// Randomly pick next energy and material for the particle.
+				// Also incorporates results from the macro_xs lookup to
+				// enforce a loop dependency. In a real MC app, this dependency
+				// is expressed in terms of branching physics sampling, whereas
+				// here we are just artificially enforcing it by altering the seed.
+				uint64_t n_forward = 0;
+				for( int j = 0; j < 5; j++ )
+					if( macro_xs_vector[j] > 1.0 )
+						n_forward++;
+				if( n_forward > 0 )
+					seed = fast_forward_LCG(seed, n_forward);
+
+				if( in.correlated )
+				{
+					// Slow down by elastic scattering, which leaves the particle
+					// with HISTORY_ALPHA to all of its energy. Thermalized
+					// particles are replaced by a new source particle.
+					p_energy *= HISTORY_ALPHA + ( 1.0 - HISTORY_ALPHA ) * LCG_random_double(&seed);
+					if( p_energy < HISTORY_E_CUTOFF )
+						p_energy = LCG_random_double(&seed);
+					if( LCG_random_double(&seed) < HISTORY_MOVE_PROB )
+						mat = pick_mat(&seed);
+				}
+				else
+				{
+					p_energy = LCG_random_double(&seed);
+					mat      = pick_mat(&seed);
+				}
+			}
+		}
+
+		if( K == 0 )
+			verification = verification_k;
+	}
+
+	return verification;
+}
+
+// Calculates the microscopic cross section for a given nuclide & energy.
+// This is the specializable body of calculate_micro_xs: it is always inlined,
+// and when grid_type and n_isotopes are compile-time constants at the call
+// site (see calculate_macro_xs), the untaken grid type branches are dropped
+// and the nuc*n_gridpoints and idx*n_isotopes indexing is strength-reduced.
+static inline __attribute__((always_inline))
+void micro_xs_kernel(      double p_energy, int nuc, const long n_isotopes,
                            long n_gridpoints,
                            double *  egrid, int *  index_data,
                            NuclideGridPoint *  nuclide_grids,
-                           long idx, double *  xs_vector, int grid_type, int hash_bins ){
+                           long idx, double *  xs_vector, const int grid_type, int hash_bins,
+                           int * hints ){
 	// Variables
 	double f;
 	NuclideGridPoint * low, * high;
 
 	// If using only the nuclide grid, we must perform a binary search
 	// to find the energy location in this particular nuclide's grid.
+	// If the caller keeps search hints (i.e., the index found by the
+	// previous lookup for this nuclide), the search starts from there.
+	// Otherwise, if there is a log grid for the nuclide ("hash_bins" > 0),
+	// the search is limited to the log grid bin holding the energy.
 	if( grid_type == NUCLIDE )
 	{
-		// Perform binary search on the Nuclide Grid to find the index
-		idx = grid_search_nuclide( n_gridpoints, p_energy, &nuclide_grids[nuc*n_gridpoints], 0, n_gridpoints-1);
+		if( hints != NULL )
+		{
+			int * hint = &hints[nuc & (NUCLIDE_HINT_SLOTS - 1)];
+			idx = grid_search_nuclide_hint( n_gridpoints, p_energy, &nuclide_grids[nuc*n_gridpoints], *hint);
+			*hint = idx;
+		}
+		else if( hash_bins > 0 )
+		{
+			// Bounding indices of the log grid bin (idx == -1 is the bin
+			// below the first log grid energy)
+			int * log_grid = &index_data[nuc * (hash_bins + 1)];
+			long u_low  = ( idx < 0 ) ? 0 : log_grid[idx];
+			long u_high = log_grid[idx + 1] + 1;
+			if( u_high > n_gridpoints - 1 )
+				u_high = n_gridpoints - 1;
+
+			// The bin is computed with a log, so it may be off by one for
+			// energies right at a bin boundary. If so, widen the search.
+			if( p_energy < nuclide_grids[nuc*n_gridpoints + u_low].energy )
+				u_low = 0;
+			if( p_energy >= nuclide_grids[nuc*n_gridpoints + u_high].energy )
+				u_high = n_gridpoints - 1;
+
+			idx = grid_search_nuclide( n_gridpoints, p_energy, &nuclide_grids[nuc*n_gridpoints], u_low, u_high);
+		}
+		else // Perform binary search on the Nuclide Grid to find the index
+			idx = grid_search_nuclide( n_gridpoints, p_energy, &nuclide_grids[nuc*n_gridpoints], 0, n_gridpoints-1);
 
 		// pull ptr from nuclide grid and check to ensure that
 		// we're not reading off the end of the nuclide's grid
@@ -418,27 +603,52 @@ void calculate_micro_xs(   double p_energy, int nuc, long n_isotopes,
 	
 }
 
-// Calculates macroscopic cross section based on a given material & energy 
-void calculate_macro_xs( double p_energy, int mat, long n_isotopes,
-                         long n_gridpoints, int *  num_nucs,
-                         double *  concs,
-                         double *  egrid, int *  index_data,
-                         NuclideGridPoint *  nuclide_grids,
-                         int *  mats,
-                         double *  macro_xs_vector, int grid_type, int hash_bins, int max_num_nucs ){
-	int p_nuc; // the nuclide we are looking up
-	long idx = -1;	
-	double conc; // the concentration of the nuclide in the material
+// Calculates the microscopic cross section for a given nuclide & energy
+void calculate_micro_xs(   double p_energy, int nuc, long n_isotopes,
+                           long n_gridpoints,
+                           double *  egrid, int *  index_data,
+                           NuclideGridPoint *  nuclide_grids,
+                           long idx, double *  xs_vector, int grid_type, int hash_bins ){
+	micro_xs_kernel( p_energy, nuc, n_isotopes, n_gridpoints, egrid, index_data,
+	                 nuclide_grids, idx, xs_vector, grid_type, hash_bins, NULL );
+}
 
-	// cleans out macro_xs_vector
-	for( int k = 0; k < 5; k++ )
-		macro_xs_vector[k] = 0;
+// Calculates the microscopic cross sections of the n_nucs nuclides "nucs" at
+// the same energy and grid index (see calculate_grid_index), storing those of
+// nucs[n] in xs_vectors[5*n .. 5*n+4], with one instantiation per grid type
+void calculate_micro_xs_nucs( double p_energy, int n_nucs, int * nucs, long n_isotopes,
+                              long n_gridpoints,
+                              double *  egrid, int *  index_data,
+                              NuclideGridPoint *  nuclide_grids,
+                              long idx, double *  xs_vectors, int grid_type, int hash_bins ){
+	#define MICRO_XS_NUCS_INSTANCE(GRID_TYPE) \
+		for( int n = 0; n < n_nucs; n++ ) \
+			micro_xs_kernel( p_energy, nucs[n], n_isotopes, n_gridpoints, egrid, index_data, \
+			                 nuclide_grids, idx, &xs_vectors[n*5], GRID_TYPE, hash_bins, NULL )
+
+	switch( grid_type )
+	{
+		case UNIONIZED: MICRO_XS_NUCS_INSTANCE(UNIONIZED); break;
+		case NUCLIDE:   MICRO_XS_NUCS_INSTANCE(NUCLIDE);   break;
+		default:        MICRO_XS_NUCS_INSTANCE(HASH);      break;
+	}
+
+	#undef MICRO_XS_NUCS_INSTANCE
+}
+
+// Finds the index of an energy in the lookup acceleration structure, which is
+// shared by all nuclides of a macroscopic lookup.
+static inline __attribute__((always_inline))
+long macro_xs_grid_index( double p_energy, const long n_isotopes, long n_gridpoints,
+                          double *  egrid, const int grid_type, int hash_bins ){
+	long idx = -1;
 
 	// If we are using the unionized energy grid (UEG), we only
 	// need to perform 1 binary search per macroscopic lookup.
 	// If we are using the nuclide grid search, it will have to be
 	// done inside of the "calculate_micro_xs" function for each different
-	// nuclide in the material.
+	// nuclide in the material (though if there are log grids, the log
+	// grid bin is computed only once here).
 	if( grid_type == UNIONIZED )
 		idx = grid_search( n_isotopes * n_gridpoints, p_energy, egrid);	
 	else if( grid_type == HASH )
@@ -446,6 +656,47 @@ void calculate_macro_xs( double p_energy, int mat, long n_isotopes,
 		double du = 1.0 / hash_bins;
 		idx = p_energy / du;
 	}
+	else if( hash_bins > 0 ) // Nuclide grid with per-nuclide log grids
+	{
+		if( p_energy < LOG_GRID_E_MIN )
+			idx = -1;
+		else
+		{
+			idx = log(p_energy / LOG_GRID_E_MIN) / log(1.0 / LOG_GRID_E_MIN) * hash_bins;
+			if( idx > hash_bins - 1 )
+				idx = hash_bins - 1;
+		}
+	}
+
+	return idx;
+}
+
+// Finds the index of an energy in the lookup acceleration structure
+long calculate_grid_index( double p_energy, long n_isotopes, long n_gridpoints,
+                           double *  egrid, int grid_type, int hash_bins ){
+	return macro_xs_grid_index( p_energy, n_isotopes, n_gridpoints, egrid, grid_type, hash_bins );
+}
+
+// Calculates macroscopic cross section based on a given material & energy.
+// Like micro_xs_kernel, this is always inlined into one of the specialized
+// instantiations selected by calculate_macro_xs.
+static inline __attribute__((always_inline))
+void macro_xs_kernel(    double p_energy, int mat, const long n_isotopes,
+                         long n_gridpoints, int *  num_nucs,
+                         double *  concs,
+                         double *  egrid, int *  index_data,
+                         NuclideGridPoint *  nuclide_grids,
+                         int *  mats,
+                         double *  macro_xs_vector, const int grid_type, int hash_bins, const int max_num_nucs,
+                         int * hints ){
+	int p_nuc; // the nuclide we are looking up
+	double conc; // the concentration of the nuclide in the material
+
+	// cleans out macro_xs_vector
+	for( int k = 0; k < 5; k++ )
+		macro_xs_vector[k] = 0;
+
+	long idx = macro_xs_grid_index( p_energy, n_isotopes, n_gridpoints, egrid, grid_type, hash_bins );
 	
 	// Once we find the pointer array on the UEG, we can pull the data
 	// from the respective nuclide grids, as well as the nuclide
@@ -462,9 +713,9 @@ void calculate_macro_xs( double p_energy, int mat, long n_isotopes,
 		double xs_vector[5];
 		p_nuc = mats[mat*max_num_nucs + j];
 		conc = concs[mat*max_num_nucs + j];
-		calculate_micro_xs( p_energy, p_nuc, n_isotopes,
-		                    n_gridpoints, egrid, index_data,
-		                    nuclide_grids, idx, xs_vector, grid_type, hash_bins );
+		micro_xs_kernel( p_energy, p_nuc, n_isotopes,
+		                 n_gridpoints, egrid, index_data,
+		                 nuclide_grids, idx, xs_vector, grid_type, hash_bins, hints );
 		for( int k = 0; k < 5; k++ )
 			macro_xs_vector[k] += xs_vector[k] * conc;
 	}
@@ -477,6 +728,64 @@ void calculate_macro_xs( double p_energy, int mat, long n_isotopes,
 			   */
 }
 
+// Calculates macroscopic cross section based on a given material & energy 
+//
+// The lookup kernel is instantiated once per grid type, and additionally for
+// the H-M small (68 isotopes, 34 fuel nuclides) and H-M large (355 isotopes,
+// 321 fuel nuclides) problem sizes, with these values baked in as constants.
+// All dispatch arguments are uniform across a run, so the switch below always
+// takes the same path and costs a single well-predicted branch per lookup
+// instead of a grid type branch for every nuclide in the material.
+//
+// "hints" optionally points to NUCLIDE_HINT_SLOTS per-particle search hints,
+// which are used and updated by nuclide grid lookups (NULL if none).
+void calculate_macro_xs( double p_energy, int mat, long n_isotopes,
+                         long n_gridpoints, int *  num_nucs,
+                         double *  concs,
+                         double *  egrid, int *  index_data,
+                         NuclideGridPoint *  nuclide_grids,
+                         int *  mats,
+                         double *  macro_xs_vector, int grid_type, int hash_bins, int max_num_nucs,
+                         int * hints ){
+	#define MACRO_XS_INSTANCE(GRID_TYPE, N_ISOTOPES, MAX_NUM_NUCS, HINTS) \
+		macro_xs_kernel( p_energy, mat, N_ISOTOPES, n_gridpoints, num_nucs, concs, \
+		                 egrid, index_data, nuclide_grids, mats, macro_xs_vector, \
+		                 GRID_TYPE, hash_bins, MAX_NUM_NUCS, HINTS )
+
+	int hm_small = ( n_isotopes == 68  && max_num_nucs == 34  );
+	int hm_large = ( n_isotopes == 355 && max_num_nucs == 321 );
+
+	switch( grid_type )
+	{
+		case UNIONIZED:
+			if( hm_small )      MACRO_XS_INSTANCE(UNIONIZED, 68, 34, NULL);
+			else if( hm_large ) MACRO_XS_INSTANCE(UNIONIZED, 355, 321, NULL);
+			else                MACRO_XS_INSTANCE(UNIONIZED, n_isotopes, max_num_nucs, NULL);
+			break;
+		case NUCLIDE:
+			if( hints != NULL )
+			{
+				if( hm_small )      MACRO_XS_INSTANCE(NUCLIDE, 68, 34, hints);
+				else if( hm_large ) MACRO_XS_INSTANCE(NUCLIDE, 355, 321, hints);
+				else                MACRO_XS_INSTANCE(NUCLIDE, n_isotopes, max_num_nucs, hints);
+			}
+			else
+			{
+				if( hm_small )      MACRO_XS_INSTANCE(NUCLIDE, 68, 34, NULL);
+				else if( hm_large ) MACRO_XS_INSTANCE(NUCLIDE, 355, 321, NULL);
+				else                MACRO_XS_INSTANCE(NUCLIDE, n_isotopes, max_num_nucs, NULL);
+			}
+			break;
+		default: // Hash grid
+			if( hm_small )      MACRO_XS_INSTANCE(HASH, 68, 34, NULL);
+			else if( hm_large ) MACRO_XS_INSTANCE(HASH, 355, 321, NULL);
+			else                MACRO_XS_INSTANCE(HASH, n_isotopes, max_num_nucs, NULL);
+			break;
+	}
+
+	#undef MACRO_XS_INSTANCE
+}
+
 
 // binary search for energy on unionized energy grid
 // returns lower index
@@ -525,6 +834,50 @@ long grid_search_nuclide( long n, double quarry, NuclideGridPoint * A, long low,
 	return lowerLimit;
 }
 
+// Nuclide grid search that starts from the index "hint" found by a previous
+// search, and returns the same index as a full grid_search_nuclide. It gallops
+// away from the hint in steps of 1, 2, 4, ... gridpoints until the energy is
+// bracketed, and then bisects the bracket. If the energy is not bracketed after
+// HINT_GALLOP_STEPS steps, it falls back to bisecting the rest of the grid, so
+// a useless hint costs at most a few extra comparisons.
+long grid_search_nuclide_hint( long n, double quarry, NuclideGridPoint * A, long hint)
+{
+	if( hint < 0 || hint > n - 2 )
+		return grid_search_nuclide( n, quarry, A, 0, n-1);
+
+	long step = 1;
+	if( A[hint].energy <= quarry )
+	{
+		long low = hint;
+		for( int s = 0; s < HINT_GALLOP_STEPS; s++ )
+		{
+			long high = low + step;
+			if( high >= n - 1 )
+				break;
+			if( A[high].energy > quarry )
+				return grid_search_nuclide( n, quarry, A, low, high);
+			low = high;
+			step *= 2;
+		}
+		return grid_search_nuclide( n, quarry, A, low, n-1);
+	}
+	else
+	{
+		long high = hint;
+		for( int s = 0; s < HINT_GALLOP_STEPS; s++ )
+		{
+			long low = high - step;
+			if( low <= 0 )
+				break;
+			if( A[low].energy <= quarry )
+				return grid_search_nuclide( n, quarry, A, low, high);
+			high = low;
+			step *= 2;
+		}
+		return grid_search_nuclide( n, quarry, A, 0, high);
+	}
+}
+
 // picks a material based on a probabilistic distribution
 int pick_mat( uint64_t * seed )
 {
@@ -605,3 +958,775 @@ uint64_t fast_forward_LCG(uint64_t seed, uint64_t n)
 	return (a_new * seed + c_new) % m;
 
 }
+
+////////////////////////////////////////////////////////////////////////////////////
+// OPTIMIZED VARIANT FUNCTIONS
+////////////////////////////////////////////////////////////////////////////////////
+// This section contains a number of optimized variants of some of the above
+// functions, which each deploy a different combination of optimizations
+// strategies. By default, XSBench will not run any of these variants. They
+// must be specifically selected using the "-k <optimized variant ID>" command
+// line argument.
+////////////////////////////////////////////////////////////////////////////////////
+
+// Stable LSD radix sort of "n" keys, and of their payloads, on a device. Each
+// pass splits the keys into SORT_BLOCKS blocks: every block counts its digits,
+// the counts are scanned in (digit, block) order to find where each block
+// writes each digit, and every block then scatters its keys in order. "key"
+// and "val" must have room for 2*n elements, as the second half of each is
+// used as the scatter target. Returns the sorted payloads (in either half).
+static int * sort_by_key_on_device( uint32_t * key, int * val, long * hist, long n, int device )
+{
+	uint32_t * key_alt = key + n;
+	int      * val_alt = val + n;
+	long block = ( n + SORT_BLOCKS - 1 ) / SORT_BLOCKS;
+
+	for( int shift = 32 - SORT_KEY_BITS; shift < 32; shift += SORT_RADIX_BITS )
+	{
+		#pragma omp target teams distribute parallel for is_device_ptr(key, hist) device(device)
+		for( long b = 0; b < SORT_BLOCKS; b++ )
+		{
+			for( long d = 0; d < SORT_RADIX; d++ )
+				hist[d * SORT_BLOCKS + b] = 0;
+			long end = ( (b+1) * block < n ) ? (b+1) * block : n;
+			for( long i = b * block; i < end; i++ )
+				hist[((key[i] >> shift) & (SORT_RADIX - 1)) * SORT_BLOCKS + b]++;
+		}
+
+		#pragma omp target is_device_ptr(hist) device(device)
+		{
+			long sum = 0;
+			for( long j = 0; j < SORT_RADIX * SORT_BLOCKS; j++ )
+			{
+				long count = hist[j];
+				hist[j] = sum;
+				sum += count;
+			}
+		}
+
+		#pragma omp target teams distribute parallel for is_device_ptr(key, val, key_alt, val_alt, hist) device(device)
+		for( long b = 0; b < SORT_BLOCKS; b++ )
+		{
+			long end = ( (b+1) * block < n ) ? (b+1) * block : n;
+			for( long i = b * block; i < end; i++ )
+			{
+				long pos = hist[((key[i] >> shift) & (SORT_RADIX - 1)) * SORT_BLOCKS + b]++;
+				key_alt[pos] = key[i];
+				val_alt[pos] = val[i];
+			}
+		}
+
+		uint32_t * key_tmp = key; key = key_alt; key_alt = key_tmp;
+		int      * val_tmp = val; val = val_alt; val_alt = val_tmp;
+	}
+
+	return val;
+}
+
+unsigned long long run_event_based_simulation_optimization_1(Inputs in, SimulationData SD, int mype)
+{
+	if( mype == 0)	
+		printf("Beginning event based simulation (energy sorted lookups)...\n");
+
+	////////////////////////////////////////////////////////////////////////////////
+	// OPTIMIZATION 1: Energy Sorted Lookups
+	// Lookups are run in batches of in.sort_batch. Each batch is sampled on the
+	// device exactly as in the baseline, radix sorted by energy, and then run in
+	// energy order, so that consecutive lookups touch nearby parts of the
+	// unionized energy array, index grid and nuclide grids. The verification
+	// hash is a sum over all lookups, so the order does not change it.
+	// Every device runs all lookups, like in the baseline, so the hash of
+	// the first device is returned.
+	// If no devices are available, the target regions are run on the host
+	// (i.e., the initial device) instead.
+	////////////////////////////////////////////////////////////////////////////////
+	int num_devices = omp_get_num_devices();
+	int on_host = ( num_devices == 0 );
+	if( on_host )
+		num_devices = 1;
+	unsigned long chunk = in.lookups;
+	unsigned long batch = in.sort_batch;
+
+	printf("Num Devices: %d\nChunk Size: %lu\nSort Batch Size: %lu\n", on_host ? 0 : num_devices, chunk, batch);
+
+	unsigned long long verification = 0;
+	double sort_time = 0;   // Sampling and sorting time of the first device
+	double lookup_time = 0; // Lookup time of the first device
+
+	#pragma omp parallel for num_threads(num_devices)
+	for (int K = 0; K < num_devices; K++) {
+		int device = on_host ? omp_get_initial_device() : K;
+		unsigned long first = 0;
+		unsigned long last  = chunk;
+		unsigned long long verification_k = 0;
+
+		// Batch buffers (the keys and payloads are double length, see
+		// sort_by_key_on_device)
+		long max_n = ( last - first < batch ) ? last - first : batch;
+		double   * energy_d = (double *)   omp_target_alloc( max_n * sizeof(double), device);
+		int      * mat_d    = (int *)      omp_target_alloc( max_n * sizeof(int), device);
+		uint32_t * key_d    = (uint32_t *) omp_target_alloc( 2 * max_n * sizeof(uint32_t), device);
+		int      * perm_d   = (int *)      omp_target_alloc( 2 * max_n * sizeof(int), device);
+		long     * hist_d   = (long *)     omp_target_alloc( SORT_RADIX * SORT_BLOCKS * sizeof(long), device);
+		assert(energy_d != NULL && mat_d != NULL && key_d != NULL && perm_d != NULL && hist_d != NULL);
+
+		int * num_nucs = SD.num_nucs;
+		double * concs = SD.concs;
+		int * mats = SD.mats;
+		double * unionized_energy_array = SD.unionized_energy_array;
+		int * index_grid = SD.index_grid;
+		NuclideGridPoint * nuclide_grid = SD.nuclide_grid;
+		int max_num_nucs = SD.max_num_nucs;
+
+		#pragma omp target data \
+				map(to: num_nucs[:SD.length_num_nucs]) \
+				map(to: concs[:SD.length_concs]) \
+				map(to: mats[:SD.length_mats]) \
+				map(to: unionized_energy_array[:SD.length_unionized_energy_array]) \
+				map(to: index_grid[:SD.length_index_grid]) \
+				map(to: nuclide_grid[:SD.length_nuclide_grid]) \
+				device(device)
+		for( unsigned long start = first; start < last; start += batch )
+		{
+			long n = ( last - start < batch ) ? last - start : batch;
+			double t_start = omp_get_wtime();
+
+			// Sample the batch, with the energy (scaled to 32 bits) as sort key
+			#pragma omp target teams distribute parallel for is_device_ptr(energy_d, mat_d, key_d, perm_d) device(device)
+			for( long j = 0; j < n; j++ )
+			{
+				// Forward seed to lookup index (we need 2 samples per lookup)
+				uint64_t seed = fast_forward_LCG(STARTING_SEED, 2*(start + j));
+
+				// Randomly pick an energy and material for the particle
+				energy_d[j] = LCG_random_double(&seed);
+				mat_d[j]    = pick_mat(&seed);
+
+				key_d[j]  = (uint32_t) ( energy_d[j] * 4294967296.0 );
+				perm_d[j] = j;
+			}
+
+			int * order_d = sort_by_key_on_device( key_d, perm_d, hist_d, n, device );
+
+			double t_sorted = omp_get_wtime();
+
+			#pragma omp target teams distribute parallel for reduction(+:verification_k) \
+					map(tofrom: verification_k) \
+					is_device_ptr(energy_d, mat_d, order_d) \
+					device(device)
+			for( long j = 0; j < n; j++ )
+			{
+				long s = order_d[j];
+
+				double macro_xs_vector[5] = {0};
+
+				// Perform macroscopic Cross Section Lookup
+				calculate_macro_xs(
+					energy_d[s],     // Sampled neutron energy (in lethargy)
+					mat_d[s],        // Sampled material type index neutron is in
+					in.n_isotopes,   // Total number of isotopes in simulation
+					in.n_gridpoints, // Number of gridpoints per isotope in simulation
+					num_nucs,        // 1-D array with number of nuclides per material
+					concs,           // Flattened 2-D array with concentration of each nuclide in each material
+					unionized_energy_array, // 1-D Unionized energy array
+					index_grid,      // Flattened 2-D grid holding indices into nuclide grid for each unionized energy level
+					nuclide_grid,    // Flattened 2-D grid holding energy levels and XS_data for all nuclides in simulation
+					mats,            // Flattened 2-D array with nuclide indices defining composition of each type of material
+					macro_xs_vector, // 1-D array with result of the macroscopic cross section (5 different reaction channels)
+					in.grid_type,    // Lookup type (nuclide, hash, or unionized)
+					in.hash_bins,    // Number of hash bins used (if using hash lookup type)
+					max_num_nucs,    // Maximum number of nuclides present in any material
+					NULL             // No search hints
+				);
+
+				// For verification, and to prevent the compiler from optimizing
+				// all work out, we interrogate the returned macro_xs_vector array
+				// to find its maximum value index, then increment the verification
+				// value by that index.
+				double max = -1.0;
+				int max_idx = 0;
+				for(int k = 0; k < 5; k++ )
+				{
+					if( macro_xs_vector[k] > max )
+					{
+						max = macro_xs_vector[k];
+						max_idx = k;
+					}
+				}
+				verification_k += max_idx+1;
+			}
+
+			if( K == 0 )
+			{
+				sort_time   += t_sorted - t_start;
+				lookup_time += omp_get_wtime() - t_sorted;
+			}
+		}
+
+		omp_target_free(energy_d, device);
+		omp_target_free(mat_d, device);
+		omp_target_free(key_d, device);
+		omp_target_free(perm_d, device);
+		omp_target_free(hist_d, device);
+
+		if( K == 0 )
+			verification = verification_k;
+	}
+
+	if( mype == 0 )
+		printf("Sample & Sort Time (device 0): %.3lf seconds\nLookup Time (device 0):        %.3lf seconds\n", sort_time, lookup_time);
+
+	return verification;
+}
+
+unsigned long long run_event_based_simulation_optimization_2(Inputs in, SimulationData SD, int mype)
+{
+	if( mype == 0)	
+		printf("Beginning event based simulation (cooperative heavy material lookups)...\n");
+
+	////////////////////////////////////////////////////////////////////////////////
+	// OPTIMIZATION 2: Cooperative Heavy Material Lookups
+	// The fuel has far more nuclides than any other material (321 vs. at most
+	// 27 in H-M large), so with one thread per lookup, fuel lookups dominate
+	// the run time of every team and cause severe divergence. Here, lookups are
+	// run in batches of in.sort_batch, in two passes. The first pass runs the
+	// light material lookups with one thread per lookup, and lists the heavy
+	// material lookups (more than COOP_MIN_NUCS nuclides). The second pass runs
+	// each heavy lookup on a whole team, whose threads split the nuclide loop
+	// and reduce the 5 XS channels. When the target regions run on the host
+	// (no devices, or offloading disabled), a team is a single thread, and
+	// each heavy lookup splits its nuclide loop across SIMD lanes instead.
+	// Every device runs all lookups, like in the baseline, so the hash of
+	// the first device is returned.
+	////////////////////////////////////////////////////////////////////////////////
+	int num_devices = omp_get_num_devices();
+	int on_host = ( num_devices == 0 );
+	if( on_host )
+		num_devices = 1;
+	unsigned long chunk = in.lookups;
+	unsigned long batch = in.sort_batch;
+
+	printf("Num Devices: %d\nChunk Size: %lu\nBatch Size: %lu\n", on_host ? 0 : num_devices, chunk, batch);
+
+	unsigned long long verification = 0;
+	unsigned long heavy_lookups = 0; // Heavy material lookups of the first device
+
+	#pragma omp parallel for num_threads(num_devices)
+	for (int K = 0; K < num_devices; K++) {
+		int device = on_host ? omp_get_initial_device() : K;
+		unsigned long first = 0;
+		unsigned long last  = chunk;
+		unsigned long long verification_k = 0;
+
+		// Whether target regions on this device run on the host
+		int host_exec = 1;
+		#pragma omp target map(from: host_exec) device(device)
+		host_exec = omp_is_initial_device();
+
+		// Batch offsets of the heavy material lookups
+		long max_n = ( last - first < batch ) ? last - first : batch;
+		int * heavy_d = (int *) omp_target_alloc( max_n * sizeof(int), device);
+		assert(heavy_d != NULL);
+
+		int * num_nucs = SD.num_nucs;
+		double * concs = SD.concs;
+		int * mats = SD.mats;
+		double * unionized_energy_array = SD.unionized_energy_array;
+		int * index_grid = SD.index_grid;
+		NuclideGridPoint * nuclide_grid = SD.nuclide_grid;
+		int max_num_nucs = SD.max_num_nucs;
+
+		#pragma omp target data \
+				map(to: num_nucs[:SD.length_num_nucs]) \
+				map(to: concs[:SD.length_concs]) \
+				map(to: mats[:SD.length_mats]) \
+				map(to: unionized_energy_array[:SD.length_unionized_energy_array]) \
+				map(to: index_grid[:SD.length_index_grid]) \
+				map(to: nuclide_grid[:SD.length_nuclide_grid]) \
+				device(device)
+		for( unsigned long start = first; start < last; start += batch )
+		{
+			long n = ( last - start < batch ) ? last - start : batch;
+			long n_heavy = 0;
+
+			// Pass 1: light material lookups, one thread per lookup
+			#pragma omp target teams distribute parallel for reduction(+:verification_k) \
+					map(tofrom: verification_k, n_heavy) \
+					is_device_ptr(heavy_d) \
+					device(device)
+			for( long j = 0; j < n; j++ )
+			{
+				// Forward seed to lookup index (we need 2 samples per lookup)
+				uint64_t seed = fast_forward_LCG(STARTING_SEED, 2*(start + j));
+
+				// Randomly pick an energy and material for the particle
+				double p_energy = LCG_random_double(&seed);
+				int mat         = pick_mat(&seed);
+
+				// Heavy material lookups are left for the second pass
+				if( num_nucs[mat] > COOP_MIN_NUCS )
+				{
+					long pos;
+					#pragma omp atomic capture
+					pos = n_heavy++;
+					heavy_d[pos] = j;
+					continue;
+				}
+
+				double macro_xs_vector[5] = {0};
+
+				// Perform macroscopic Cross Section Lookup
+				calculate_macro_xs(
+					p_energy,        // Sampled neutron energy (in lethargy)
+					mat,             // Sampled material type index neutron is in
+					in.n_isotopes,   // Total number of isotopes in simulation
+					in.n_gridpoints, // Number of gridpoints per isotope in simulation
+					num_nucs,        // 1-D array with number of nuclides per material
+					concs,           // Flattened 2-D array with concentration of each nuclide in each material
+					unionized_energy_array, // 1-D Unionized energy array
+					index_grid,      // Flattened 2-D grid holding indices into nuclide grid for each unionized energy level
+					nuclide_grid,    // Flattened 2-D grid holding energy levels and XS_data for all nuclides in simulation
+					mats,            // Flattened 2-D array with nuclide indices defining composition of each type of material
+					macro_xs_vector, // 1-D array with result of the macroscopic cross section (5 different reaction channels)
+					in.grid_type,    // Lookup type (nuclide, hash, or unionized)
+					in.hash_bins,    // Number of hash bins used (if using hash lookup type)
+					max_num_nucs,    // Maximum number of nuclides present in any material
+					NULL             // No search hints
+				);
+
+				// For verification, and to prevent the compiler from optimizing
+				// all work out, we interrogate the returned macro_xs_vector array
+				// to find its maximum value index, then increment the verification
+				// value by that index.
+				double max = -1.0;
+				int max_idx = 0;
+				for(int k = 0; k < 5; k++ )
+				{
+					if( macro_xs_vector[k] > max )
+					{
+						max = macro_xs_vector[k];
+						max_idx = k;
+					}
+				}
+				verification_k += max_idx+1;
+			}
+
+			if( K == 0 )
+				heavy_lookups += n_heavy;
+
+			// Pass 2: heavy material lookups, one team (or, on the host, one
+			// thread and its SIMD lanes) per lookup
+			if( host_exec )
+			{
+				#pragma omp parallel for schedule(dynamic, 64) reduction(+:verification_k)
+				for( long h = 0; h < n_heavy; h++ )
+				{
+					uint64_t seed = fast_forward_LCG(STARTING_SEED, 2*(start + heavy_d[h]));
+					double p_energy = LCG_random_double(&seed);
+					int mat         = pick_mat(&seed);
+
+					long idx = macro_xs_grid_index( p_energy, in.n_isotopes, in.n_gridpoints, unionized_energy_array, in.grid_type, in.hash_bins );
+
+					double xs0 = 0, xs1 = 0, xs2 = 0, xs3 = 0, xs4 = 0;
+					#pragma omp simd reduction(+:xs0, xs1, xs2, xs3, xs4)
+					for( int j = 0; j < num_nucs[mat]; j++ )
+					{
+						double xs_vector[5];
+						double conc = concs[mat*max_num_nucs + j];
+						micro_xs_kernel( p_energy, mats[mat*max_num_nucs + j], in.n_isotopes, in.n_gridpoints,
+						                 unionized_energy_array, index_grid, nuclide_grid, idx, xs_vector,
+						                 in.grid_type, in.hash_bins, NULL );
+						xs0 += xs_vector[0] * conc;
+						xs1 += xs_vector[1] * conc;
+						xs2 += xs_vector[2] * conc;
+						xs3 += xs_vector[3] * conc;
+						xs4 += xs_vector[4] * conc;
+					}
+
+					double macro_xs_vector[5] = {xs0, xs1, xs2, xs3, xs4};
+					double max = -1.0;
+					int max_idx = 0;
+					for(int k = 0; k < 5; k++ )
+					{
+						if( macro_xs_vector[k] > max )
+						{
+							max = macro_xs_vector[k];
+							max_idx = k;
+						}
+					}
+					verification_k += max_idx+1;
+				}
+			}
+			else
+			{
+				#pragma omp target teams distribute reduction(+:verification_k) \
+						map(tofrom: verification_k) \
+						is_device_ptr(heavy_d) \
+						device(device)
+				for( long h = 0; h < n_heavy; h++ )
+				{
+					uint64_t seed = fast_forward_LCG(STARTING_SEED, 2*(start + heavy_d[h]));
+					double p_energy = LCG_random_double(&seed);
+					int mat         = pick_mat(&seed);
+
+					long idx = macro_xs_grid_index( p_energy, in.n_isotopes, in.n_gridpoints, unionized_energy_array, in.grid_type, in.hash_bins );
+
+					double xs0 = 0, xs1 = 0, xs2 = 0, xs3 = 0, xs4 = 0;
+					#pragma omp parallel for reduction(+:xs0, xs1, xs2, xs3, xs4)
+					for( int j = 0; j < num_nucs[mat]; j++ )
+					{
+						double xs_vector[5];
+						double conc = concs[mat*max_num_nucs + j];
+						micro_xs_kernel( p_energy, mats[mat*max_num_nucs + j], in.n_isotopes, in.n_gridpoints,
+						                 unionized_energy_array, index_grid, nuclide_grid, idx, xs_vector,
+						                 in.grid_type, in.hash_bins, NULL );
+						xs0 += xs_vector[0] * conc;
+						xs1 += xs_vector[1] * conc;
+						xs2 += xs_vector[2] * conc;
+						xs3 += xs_vector[3] * conc;
+						xs4 += xs_vector[4] * conc;
+					}
+
+					double macro_xs_vector[5] = {xs0, xs1, xs2, xs3, xs4};
+					double max = -1.0;
+					int max_idx = 0;
+					for(int k = 0; k < 5; k++ )
+					{
+						if( macro_xs_vector[k] > max )
+						{
+							max = macro_xs_vector[k];
+							max_idx = k;
+						}
+					}
+					verification_k += max_idx+1;
+				}
+			}
+		}
+
+		omp_target_free(heavy_d, device);
+
+		if( K == 0 )
+			verification = verification_k;
+	}
+
+	if( mype == 0 )
+		printf("Heavy Material Lookups (device 0): %.1lf%%\n", 100.0 * heavy_lookups / ( chunk > 0 ? chunk : 1 ));
+
+	return verification;
+}
+
+// Launches the lookups of one material (queue_m holds their offsets into the
+// batch samples energy_d) as a kernel that runs asynchronously (nowait), and
+// adds their verification hash to *hash once it completes (i.e., at the next
+// taskwait). The problem parameters are passed as scalars, as a struct would
+// be mapped by reference to this (by then returned) function's frame. Like
+// micro_xs_kernel, this is always inlined into one of the
+// instantiations selected by launch_material_kernel, so n_nucs is a
+// compile-time constant. Each team first stages the material's row of mats
+// and concs in team-local memory, from where all of its lookups read it.
+static inline __attribute__((always_inline))
+void material_kernel_nowait( long n_isotopes, long n_gridpoints, int grid_type, int hash_bins, long n_m, int * queue_m, double * energy_d,
+                             int * mat_row, double * conc_row, const int n_nucs,
+                             double * egrid, int * index_grid, NuclideGridPoint * nuclide_grid,
+                             unsigned long long * hash, int device )
+{
+	#pragma omp target teams nowait reduction(+:hash[0:1]) map(tofrom: hash[0:1]) \
+			is_device_ptr(queue_m, mat_row, conc_row, energy_d, egrid, index_grid, nuclide_grid) \
+			device(device)
+	{
+		int mat_row_t[MATERIAL_ROW_MAX];
+		double conc_row_t[MATERIAL_ROW_MAX];
+		#if _OPENMP >= 201811
+		#pragma omp allocate(mat_row_t, conc_row_t) allocator(omp_pteam_mem_alloc)
+		#endif
+
+		#pragma omp parallel for
+		for( int k = 0; k < n_nucs; k++ )
+		{
+			mat_row_t[k] = mat_row[k];
+			conc_row_t[k] = conc_row[k];
+		}
+
+		#pragma omp distribute parallel for reduction(+:hash[0:1])
+		for( long q = 0; q < n_m; q++ )
+		{
+			double p_energy = energy_d[queue_m[q]];
+
+			long idx = macro_xs_grid_index( p_energy, n_isotopes, n_gridpoints, egrid, grid_type, hash_bins );
+
+			double macro_xs_vector[5] = {0};
+			for( int k = 0; k < n_nucs; k++ )
+			{
+				double xs_vector[5];
+				micro_xs_kernel( p_energy, mat_row_t[k], n_isotopes, n_gridpoints,
+				                 egrid, index_grid, nuclide_grid, idx, xs_vector,
+				                 grid_type, hash_bins, NULL );
+				for( int c = 0; c < 5; c++ )
+					macro_xs_vector[c] += xs_vector[c] * conc_row_t[k];
+			}
+
+			// For verification, and to prevent the compiler from optimizing
+			// all work out, we interrogate the returned macro_xs_vector array
+			// to find its maximum value index, then increment the verification
+			// value by that index.
+			double max = -1.0;
+			int max_idx = 0;
+			for(int c = 0; c < 5; c++ )
+			{
+				if( macro_xs_vector[c] > max )
+				{
+					max = macro_xs_vector[c];
+					max_idx = c;
+				}
+			}
+			hash[0] += max_idx+1;
+		}
+	}
+}
+
+// Launches the kernel of one material (see material_kernel_nowait). The
+// kernel is instantiated for each material size of H-M small and large (the
+// fuel has 34 or 321 nuclides, the other materials 4 to 27), with the
+// nuclide count baked in as a constant, like in calculate_macro_xs.
+static void launch_material_kernel( Inputs in, long n_m, int * queue_m, double * energy_d,
+                                    int * mat_row, double * conc_row, int n_nucs,
+                                    double * egrid, int * index_grid, NuclideGridPoint * nuclide_grid,
+                                    unsigned long long * hash, int device )
+{
+	assert( n_nucs <= MATERIAL_ROW_MAX );
+
+	#define MATERIAL_KERNEL_INSTANCE(N_NUCS) \
+		material_kernel_nowait( in.n_isotopes, in.n_gridpoints, in.grid_type, in.hash_bins, n_m, queue_m, energy_d, mat_row, conc_row, N_NUCS, \
+		                        egrid, index_grid, nuclide_grid, hash, device )
+
+	switch( n_nucs )
+	{
+		case 4:   MATERIAL_KERNEL_INSTANCE(4);   break;
+		case 5:   MATERIAL_KERNEL_INSTANCE(5);   break;
+		case 9:   MATERIAL_KERNEL_INSTANCE(9);   break;
+		case 21:  MATERIAL_KERNEL_INSTANCE(21);  break;
+		case 27:  MATERIAL_KERNEL_INSTANCE(27);  break;
+		case 34:  MATERIAL_KERNEL_INSTANCE(34);  break;
+		case 321: MATERIAL_KERNEL_INSTANCE(321); break;
+		default:  MATERIAL_KERNEL_INSTANCE(n_nucs); break;
+	}
+
+	#undef MATERIAL_KERNEL_INSTANCE
+}
+
+unsigned long long run_event_based_simulation_optimization_3(Inputs in, SimulationData SD, int mype)
+{
+	if( mype == 0)	
+		printf("Beginning event based simulation (per-material kernels)...\n");
+
+	////////////////////////////////////////////////////////////////////////////////
+	// OPTIMIZATION 3: Per-Material Kernels
+	// Lookups are run in batches of in.sort_batch. Each batch is sampled on the
+	// device and bucketed into one queue per material, and then one kernel per
+	// material is launched, with all kernels running concurrently (nowait).
+	// Each kernel is specialized on its material's nuclide count (see
+	// launch_material_kernel), so the nuclide loop has a constant bound and
+	// does not diverge, and all lookups read the same row of mats and concs,
+	// which each team stages in team-local memory.
+	// Every device runs all lookups, like in the baseline, so the hash of
+	// the first device is returned.
+	// The simulation data is broadcast to the devices like in the baseline:
+	// from the host to devices 0 and 4, then down a binary tree over the
+	// first devices of the groups of 4, and from each of those to the other
+	// devices of its group.
+	// If no devices are available, the target regions are run on the host
+	// (i.e., the initial device) instead.
+	////////////////////////////////////////////////////////////////////////////////
+	int num_devices = omp_get_num_devices();
+	int on_host = ( num_devices == 0 );
+	if( on_host )
+		num_devices = 1;
+	unsigned long chunk = in.lookups;
+	unsigned long batch = in.sort_batch;
+	int n_mats = SD.length_num_nucs;
+
+	printf("Num Devices: %d\nChunk Size: %lu\nBatch Size: %lu\n", on_host ? 0 : num_devices, chunk, batch);
+
+	unsigned long long verification = 0;
+
+	// Lookups and kernel time of each material in the first batch of the
+	// first device (see the timing pass below), and the time of the
+	// concurrent launch of all of them
+	unsigned long mat_lookups[n_mats];
+	double mat_time[n_mats];
+	double concurrent_time = 0;
+	for( int m = 0; m < n_mats; m++ )
+	{
+		mat_lookups[m] = 0;
+		mat_time[m] = 0;
+	}
+
+	// Device 4*g is the first device of group g
+	int host_device = omp_get_initial_device();
+	SimulationData SD_d[num_devices];
+	int n_groups = ( num_devices + 3 ) / 4;
+	int n_host_groups = ( n_groups < 2 ) ? n_groups : 2;
+
+	// Groups 0 and 1 get the data from the host
+	#pragma omp parallel for num_threads(n_host_groups)
+	for (int g = 0; g < n_host_groups; g++) {
+		int device = on_host ? host_device : 4*g;
+		SD_d[4*g] = alloc_sim_data_on_device( SD, device );
+		copy_sim_data_to_device( SD_d[4*g], SD, device, host_device );
+	}
+
+	// Every other group g gets it from group (g-1)/2. The groups in
+	// [g_first, g_last) only depend on groups copied before, so they are
+	// copied concurrently.
+	for (int g_first = 2; g_first < n_groups; g_first = 2*g_first + 1) {
+		int g_last = ( 2*g_first + 1 < n_groups ) ? 2*g_first + 1 : n_groups;
+		#pragma omp parallel for num_threads(num_devices)
+		for (int g = g_first; g < g_last; g++) {
+			int source_device = 4 * ( (g-1) / 2 );
+			SD_d[4*g] = alloc_sim_data_on_device( SD, 4*g );
+			copy_sim_data_to_device( SD_d[4*g], SD_d[source_device], 4*g, source_device );
+		}
+	}
+
+	#pragma omp parallel for num_threads(num_devices)
+	for (int K = 0; K < num_devices; K++) {
+		if( K % 4 == 0 )
+			continue;
+		int source_device = (K/4) * 4;
+		SD_d[K] = alloc_sim_data_on_device( SD, K );
+		copy_sim_data_to_device( SD_d[K], SD_d[source_device], K, source_device );
+	}
+
+	#pragma omp parallel for num_threads(num_devices)
+	for (int K = 0; K < num_devices; K++) {
+		int device = on_host ? omp_get_initial_device() : K;
+		unsigned long first = 0;
+		unsigned long last  = chunk;
+		unsigned long long verification_k = 0;
+
+		int max_num_nucs = SD.max_num_nucs;
+		double *concs_dk = SD_d[K].concs;
+		int *mats_dk = SD_d[K].mats;
+		double *unionized_energy_arr_dk = SD_d[K].unionized_energy_array;
+		int *index_grid_dk = SD_d[K].index_grid;
+		NuclideGridPoint *nuclide_grid_dk = SD_d[K].nuclide_grid;
+
+		// Batch samples, per-material queues of batch offsets, and the
+		// per-material counts and queue cursors
+		long max_n = ( last - first < batch ) ? last - first : batch;
+		double * energy_d = (double *) omp_target_alloc( max_n * sizeof(double), device);
+		int    * mat_d    = (int *)    omp_target_alloc( max_n * sizeof(int), device);
+		int    * queue_d  = (int *)    omp_target_alloc( max_n * sizeof(int), device);
+		long   * count_d  = (long *)   omp_target_alloc( n_mats * sizeof(long), device);
+		assert(energy_d != NULL && mat_d != NULL && queue_d != NULL && count_d != NULL);
+
+		long count[n_mats];
+		long offset[n_mats];
+		unsigned long long mat_hash[n_mats];
+
+		for( unsigned long start = first; start < last; start += batch )
+		{
+			long n = ( last - start < batch ) ? last - start : batch;
+
+			// Sample the batch, and count the lookups of each material
+			#pragma omp target teams distribute parallel for is_device_ptr(count_d) device(device)
+			for( int m = 0; m < n_mats; m++ )
+				count_d[m] = 0;
+
+			#pragma omp target teams distribute parallel for is_device_ptr(energy_d, mat_d, count_d) device(device)
+			for( long j = 0; j < n; j++ )
+			{
+				// Forward seed to lookup index (we need 2 samples per lookup)
+				uint64_t seed = fast_forward_LCG(STARTING_SEED, 2*(start + j));
+
+				// Randomly pick an energy and material for the particle
+				energy_d[j] = LCG_random_double(&seed);
+				mat_d[j]    = pick_mat(&seed);
+
+				#pragma omp atomic
+				count_d[mat_d[j]]++;
+			}
+
+			// Start of each material's queue
+			omp_target_memcpy(count, count_d, n_mats*sizeof(long), 0, 0, host_device, device);
+			offset[0] = 0;
+			for( int m = 1; m < n_mats; m++ )
+				offset[m] = offset[m-1] + count[m-1];
+			omp_target_memcpy(count_d, offset, n_mats*sizeof(long), 0, 0, device, host_device);
+
+			// Bucket the batch into the per-material queues
+			#pragma omp target teams distribute parallel for is_device_ptr(mat_d, queue_d, count_d) device(device)
+			for( long j = 0; j < n; j++ )
+			{
+				long pos;
+				#pragma omp atomic capture
+				pos = count_d[mat_d[j]]++;
+				queue_d[pos] = j;
+			}
+
+			// Launch one kernel per material, and wait for all of them
+			double t_launch = omp_get_wtime();
+			for( int m = 0; m < n_mats; m++ )
+			{
+				mat_hash[m] = 0;
+				if( count[m] > 0 )
+					launch_material_kernel( in, count[m], queue_d + offset[m], energy_d,
+					                        mats_dk + m * max_num_nucs, concs_dk + m * max_num_nucs, SD.num_nucs[m],
+					                        unionized_energy_arr_dk, index_grid_dk, nuclide_grid_dk, &mat_hash[m], device );
+			}
+			#pragma omp taskwait
+			double t_done = omp_get_wtime();
+
+			for( int m = 0; m < n_mats; m++ )
+				verification_k += mat_hash[m];
+
+			// Timing pass (first batch of the first device). The kernels above
+			// run concurrently, so the time from the launch of one of them to
+			// its completion also includes waiting behind the others. Instead,
+			// each material's kernel is run again on its own and timed, and its
+			// hash is discarded.
+			if( K == 0 && start == first )
+			{
+				concurrent_time = t_done - t_launch;
+				for( int m = 0; m < n_mats; m++ )
+				{
+					mat_lookups[m] = count[m];
+					if( count[m] == 0 )
+						continue;
+					unsigned long long timing_hash = 0;
+					double t_start = omp_get_wtime();
+					launch_material_kernel( in, count[m], queue_d + offset[m], energy_d,
+					                        mats_dk + m * max_num_nucs, concs_dk + m * max_num_nucs, SD.num_nucs[m],
+					                        unionized_energy_arr_dk, index_grid_dk, nuclide_grid_dk, &timing_hash, device );
+					#pragma omp taskwait
+					mat_time[m] = omp_get_wtime() - t_start;
+				}
+			}
+		}
+
+		omp_target_free(energy_d, device);
+		omp_target_free(mat_d, device);
+		omp_target_free(queue_d, device);
+		omp_target_free(count_d, device);
+		free_sim_data_on_device( SD_d[K], device );
+
+		if( K == 0 )
+			verification = verification_k;
+	}
+
+	if( mype == 0 )
+	{
+		printf("Per-material split (device 0, first batch, each kernel run and timed on its own):\n");
+		printf("  Material  Nuclides      Lookups    Time (s)\n");
+		double serial_time = 0;
+		for( int m = 0; m < n_mats; m++ )
+		{
+			printf("  %8d  %8d  %11lu  %10.3lf\n", m, SD.num_nucs[m], mat_lookups[m], mat_time[m]);
+			serial_time += mat_time[m];
+		}
+		printf("  Sum of the kernels:          %10.3lf\n", serial_time);
+		printf("  All kernels run concurrently: %9.3lf\n", concurrent_time);
+	}
+
+	return verification;
+}
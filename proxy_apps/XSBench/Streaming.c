@@ -0,0 +1,395 @@
+#include "XSbench_header.h"
+
+////////////////////////////////////////////////////////////////////////////////////
+// OUT-OF-CORE STREAMING MODE
+////////////////////////////////////////////////////////////////////////////////////
+// For problems whose nuclide grid does not fit in host memory (e.g., H-M XL and
+// XXL), the nuclide grid is kept in a memory-mapped file, and lookups are run
+// on the host in batches. Each batch is bucketed by energy into bands that
+// cover an equal slice of the energy range (and thus, since gridpoint energies
+// are uniformly distributed, an equal slice of every nuclide's grid). Bands are
+// processed in ascending energy order, so only the grid pages of the current
+// band need to be resident. While a band is computed, the pages of the next
+// band are prefetched in the background, and the pages of the previous band
+// are released, both from the mapping and from the page cache (the grid file
+// is written back once after initialization, so its pages are clean and can
+// be dropped). The residency of the grid file is sampled with mincore after
+// every band, and the peak is reported.
+//
+// If the grid fits in memory, the same lookups are then run again with the
+// whole grid resident, as a baseline for the streaming rate.
+////////////////////////////////////////////////////////////////////////////////////
+
+// Target size of the nuclide grid slice covered by one energy band
+#define STREAM_BAND_BYTES (1024L * 1024L * 1024L)
+
+// Number of energy sub-bins per band used to order lookups within a band
+#define STREAM_SUB_BINS 64
+
+// File backing the streamed nuclide grid (kept open to drop its pages from
+// the page cache), and the offset of the grid in it
+static int stream_fd = -1;
+static long stream_offset = 0;
+
+// Creates a file-backed shared mapping of "bytes" bytes to hold the nuclide
+// grid in streaming mode. The file is placed in the dataset cache directory
+// if one is given (which is created if needed), or in the current directory
+// otherwise, and is unlinked right away so that it is removed when the
+// program exits.
+void * stream_map_grid( Inputs in, size_t bytes )
+{
+	if( in.cache_dir != NULL )
+		mkdir(in.cache_dir, 0755);
+
+	char fname[4096];
+	snprintf(fname, sizeof(fname), "%s/xsbench-stream-%d.grid",
+	         in.cache_dir != NULL ? in.cache_dir : ".", (int) getpid());
+
+	int fd = open(fname, O_RDWR | O_CREAT | O_TRUNC, 0600);
+	if( fd < 0 || ftruncate(fd, bytes) != 0 )
+	{
+		printf("Error: could not create streaming grid file %s!\n", fname);
+		exit(1);
+	}
+	void * grid = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if( grid == MAP_FAILED )
+	{
+		printf("Error: could not map streaming grid file %s!\n", fname);
+		exit(1);
+	}
+	stream_fd = fd;
+	unlink(fname);
+
+	// Lookups also fault in a few pages outside of their band (the first
+	// steps of the nuclide grid searches). Without this, the kernel reads a
+	// large window around each of these faults, which brings the released
+	// bands back. Bands are read ahead with MADV_WILLNEED instead.
+	madvise(grid, bytes, MADV_RANDOM);
+
+	return grid;
+}
+
+// Streams a nuclide grid that is mapped from an existing file (a binary file
+// or the dataset cache, see binary_load) instead of one created by
+// stream_map_grid. "fd" must stay open for the rest of the run, and "offset"
+// is the file offset of the grid, which must be page aligned.
+void stream_attach_grid( int fd, long offset, void * grid, size_t bytes )
+{
+	assert( offset % sysconf(_SC_PAGESIZE) == 0 );
+	stream_fd = fd;
+	stream_offset = offset;
+	madvise(grid, bytes, MADV_RANDOM);
+}
+
+// Drops the pages of the grid file holding grid bytes [start, end) (given as
+// addresses in the mapping) from the page cache
+static void stream_drop_pages( SimulationData SD, uintptr_t start, uintptr_t end )
+{
+	uintptr_t base = (uintptr_t) SD.nuclide_grid;
+	posix_fadvise(stream_fd, stream_offset + (long) ( start - base ), end - start, POSIX_FADV_DONTNEED);
+}
+
+// Issues "advice" for the pages holding gridpoints [low, high) of a nuclide grid
+static void stream_advise( NuclideGridPoint * grid, long low, long high, int advice )
+{
+	if( high <= low )
+		return;
+	uintptr_t page  = sysconf(_SC_PAGESIZE);
+	uintptr_t start = (uintptr_t) (grid + low) / page * page;
+	uintptr_t end   = (uintptr_t) (grid + high);
+	madvise((void *) start, end - start, advice);
+}
+
+// Requests (asynchronous) readahead of the grid pages needed by a band
+static void stream_prefetch_band( Inputs in, SimulationData SD, long * band_start, int band )
+{
+	for( long n = 0; n < in.n_isotopes; n++ )
+	{
+		long high = band_start[(band+1) * in.n_isotopes + n] + 2;
+		stream_advise( SD.nuclide_grid + n * in.n_gridpoints, band_start[band * in.n_isotopes + n],
+		               high < in.n_gridpoints ? high : in.n_gridpoints, MADV_WILLNEED );
+	}
+}
+
+// Releases the grid pages of a band that are not shared with the next band.
+// MADV_DONTNEED only unmaps them, so they are also dropped from the page
+// cache (which works as they are clean).
+static void stream_release_band( Inputs in, SimulationData SD, long * band_start, int band )
+{
+	uintptr_t page = sysconf(_SC_PAGESIZE);
+	for( long n = 0; n < in.n_isotopes; n++ )
+	{
+		NuclideGridPoint * grid = SD.nuclide_grid + n * in.n_gridpoints;
+		uintptr_t start = (uintptr_t) (grid + band_start[band * in.n_isotopes + n]) / page * page;
+		uintptr_t end   = (uintptr_t) (grid + band_start[(band+1) * in.n_isotopes + n]) / page * page;
+		if( end > start )
+		{
+			madvise((void *) start, end - start, MADV_DONTNEED);
+			stream_drop_pages( SD, start, end );
+		}
+	}
+}
+
+// Faults in all grid pages (used for the resident baseline)
+static void stream_touch_grid( SimulationData SD )
+{
+	long stride = sysconf(_SC_PAGESIZE) / sizeof(NuclideGridPoint);
+	double sink = 0;
+	#pragma omp parallel for reduction(+:sink)
+	for( long i = 0; i < SD.length_nuclide_grid; i += stride )
+		sink += SD.nuclide_grid[i].energy;
+	if( sink == -1.0 )
+		printf("%lf\n", sink);
+}
+
+// Bytes of the grid file that are resident in memory (page cache)
+static size_t stream_resident_bytes( SimulationData SD, size_t grid_bytes, unsigned char * vec )
+{
+	size_t page = sysconf(_SC_PAGESIZE);
+	size_t n_pages = ( grid_bytes + page - 1 ) / page;
+	if( mincore(SD.nuclide_grid, grid_bytes, vec) != 0 )
+		return 0;
+	size_t resident = 0;
+	for( size_t p = 0; p < n_pages; p++ )
+		resident += vec[p] & 1;
+	return resident * page;
+}
+
+// Energy bin of a lookup
+static int stream_bin( double energy, int n_bins )
+{
+	int bin = energy * n_bins;
+	return bin < n_bins ? bin : n_bins - 1;
+}
+
+// Runs the lookups of one band and returns their verification hash
+static unsigned long long stream_run_band( Inputs in, SimulationData SD, double * energy, int * mat, long first, long last )
+{
+	unsigned long long verification = 0;
+
+	#pragma omp parallel for schedule(dynamic, 1024) reduction(+:verification)
+	for( long i = first; i < last; i++ )
+	{
+		double macro_xs_vector[5] = {0};
+
+		calculate_macro_xs(
+			energy[i],       // Sampled neutron energy (in lethargy)
+			mat[i],          // Sampled material type index neutron is in
+			in.n_isotopes,   // Total number of isotopes in simulation
+			in.n_gridpoints, // Number of gridpoints per isotope in simulation
+			SD.num_nucs,     // 1-D array with number of nuclides per material
+			SD.concs,        // Flattened 2-D array with concentration of each nuclide in each material
+			SD.unionized_energy_array, // 1-D Unionized energy array
+			SD.index_grid,   // Flattened 2-D grid holding indices into nuclide grid for each unionized energy level
+			SD.nuclide_grid, // Flattened 2-D grid holding energy levels and XS_data for all nuclides in simulation
+			SD.mats,         // Flattened 2-D array with nuclide indices defining composition of each type of material
+			macro_xs_vector, // 1-D array with result of the macroscopic cross section (5 different reaction channels)
+			in.grid_type,    // Lookup type (nuclide, hash, or unionized)
+			in.hash_bins,    // Number of hash bins used (if using hash lookup type)
+			SD.max_num_nucs, // Maximum number of nuclides present in any material
+			NULL             // No search hints
+		);
+
+		// The verification hash is a sum over all lookups, so it does not
+		// depend on the order in which the lookups are run.
+		double max = -1.0;
+		int max_idx = 0;
+		for(int j = 0; j < 5; j++ )
+		{
+			if( macro_xs_vector[j] > max )
+			{
+				max = macro_xs_vector[j];
+				max_idx = j;
+			}
+		}
+		verification += max_idx+1;
+	}
+
+	return verification;
+}
+
+// Lookup samples of a batch, in generation order and bucketed by energy
+typedef struct{
+	double * energy;
+	int    * mat;
+	double * sorted_energy;
+	int    * sorted_mat;
+	long   * bin_start;
+} StreamBatch;
+
+// Runs all lookups, batch by batch, sweeping the energy bands of each batch
+// in ascending order, and returns their verification hash. When streaming,
+// the next band is prefetched while a band runs, the band is released after
+// it, and the peak residency of the grid file is tracked in *peak_bytes.
+static unsigned long long stream_run_lookups( Inputs in, SimulationData SD, long * band_start, int n_bands,
+                                              StreamBatch B, int streaming, size_t * peak_bytes )
+{
+	int n_bins = n_bands * STREAM_SUB_BINS;
+	long batch = in.stream_batch;
+	size_t grid_bytes = (size_t) SD.length_nuclide_grid * sizeof(NuclideGridPoint);
+	size_t page = sysconf(_SC_PAGESIZE);
+	unsigned char * vec = NULL;
+	if( streaming )
+	{
+		vec = (unsigned char *) malloc( ( grid_bytes + page - 1 ) / page );
+		assert(vec != NULL);
+		*peak_bytes = 0;
+	}
+
+	unsigned long long verification = 0;
+
+	for( unsigned long first = 0; first < in.lookups; first += batch )
+	{
+		long n = ( in.lookups - first < (unsigned long) batch ) ? (long) ( in.lookups - first ) : batch;
+
+		// Sample the batch exactly like the event based kernel does
+		#pragma omp parallel for
+		for( long i = 0; i < n; i++ )
+		{
+			uint64_t seed = fast_forward_LCG(STARTING_SEED, 2*(first + i));
+			B.energy[i] = LCG_random_double(&seed);
+			B.mat[i]    = pick_mat(&seed);
+		}
+
+		// Counting sort of the batch into energy bins
+		memset(B.bin_start, 0, (n_bins + 1) * sizeof(long));
+		for( long i = 0; i < n; i++ )
+			B.bin_start[stream_bin(B.energy[i], n_bins) + 1]++;
+		for( int b = 0; b < n_bins; b++ )
+			B.bin_start[b+1] += B.bin_start[b];
+		for( long i = 0; i < n; i++ )
+		{
+			long pos = B.bin_start[stream_bin(B.energy[i], n_bins)]++;
+			B.sorted_energy[pos] = B.energy[i];
+			B.sorted_mat[pos]    = B.mat[i];
+		}
+		for( int b = n_bins; b > 0; b-- )
+			B.bin_start[b] = B.bin_start[b-1];
+		B.bin_start[0] = 0;
+
+		// Sweep bands in ascending energy order, prefetching one band ahead
+		if( streaming )
+			stream_prefetch_band( in, SD, band_start, 0 );
+		for( int b = 0; b < n_bands; b++ )
+		{
+			if( streaming && b + 1 < n_bands )
+				stream_prefetch_band( in, SD, band_start, b + 1 );
+
+			verification += stream_run_band( in, SD, B.sorted_energy, B.sorted_mat,
+			                                 B.bin_start[b * STREAM_SUB_BINS], B.bin_start[(b+1) * STREAM_SUB_BINS] );
+
+			if( streaming )
+			{
+				size_t resident = stream_resident_bytes( SD, grid_bytes, vec );
+				if( resident > *peak_bytes )
+					*peak_bytes = resident;
+				if( n_bands > 1 )
+					stream_release_band( in, SD, band_start, b );
+			}
+		}
+	}
+
+	free(vec);
+	return verification;
+}
+
+unsigned long long run_stream_simulation(Inputs in, SimulationData SD, int mype)
+{
+	if( mype == 0 )
+		printf("Beginning out-of-core streaming simulation on host...\n");
+
+	size_t grid_bytes = (size_t) SD.length_nuclide_grid * sizeof(NuclideGridPoint);
+	int n_bands = ( grid_bytes + STREAM_BAND_BYTES - 1 ) / STREAM_BAND_BYTES;
+	int n_bins  = n_bands * STREAM_SUB_BINS;
+	long batch  = in.stream_batch;
+
+	// First gridpoint of every nuclide that a band may read. A band reads
+	// gridpoints [band_start[band], band_start[band+1] + 1], as the upper
+	// bounding gridpoint of its last lookup is also needed.
+	long * band_start = (long *) malloc( (n_bands + 1) * in.n_isotopes * sizeof(long));
+	assert(band_start != NULL);
+	#pragma omp parallel for collapse(2)
+	for( int b = 0; b <= n_bands; b++ )
+		for( long n = 0; n < in.n_isotopes; n++ )
+		{
+			long idx;
+			if( b == 0 )
+				idx = 0;
+			else if( b == n_bands )
+				idx = in.n_gridpoints;
+			else
+				idx = grid_search_nuclide( in.n_gridpoints, (double) b / n_bands, SD.nuclide_grid + n * in.n_gridpoints, 0, in.n_gridpoints - 1 );
+			band_start[b * in.n_isotopes + n] = idx;
+		}
+
+	if( mype == 0 )
+	{
+		printf("Energy bands:                 %d (%.0lf MB of nuclide grid each)\n", n_bands, grid_bytes / (double) n_bands / 1024.0 / 1024.0);
+		printf("Lookups per batch:            "); fancy_int(batch);
+	}
+
+	StreamBatch B;
+	B.energy        = (double *) malloc( batch * sizeof(double));
+	B.mat           = (int *)    malloc( batch * sizeof(int));
+	B.sorted_energy = (double *) malloc( batch * sizeof(double));
+	B.sorted_mat    = (int *)    malloc( batch * sizeof(int));
+	B.bin_start     = (long *)   malloc( (n_bins + 1) * sizeof(long));
+	assert(B.energy != NULL && B.mat != NULL && B.sorted_energy != NULL && B.sorted_mat != NULL && B.bin_start != NULL);
+
+	// Write the grid back to its file, so that its pages are clean and the
+	// released ones can be dropped from the page cache. Then start the
+	// streaming run with none of the grid resident.
+	msync(SD.nuclide_grid, grid_bytes, MS_SYNC);
+	madvise(SD.nuclide_grid, grid_bytes, MADV_DONTNEED);
+	stream_drop_pages( SD, (uintptr_t) SD.nuclide_grid, (uintptr_t) SD.nuclide_grid + grid_bytes );
+
+	size_t peak_bytes;
+	double start = omp_get_wtime();
+	unsigned long long verification = stream_run_lookups( in, SD, band_start, n_bands, B, 1, &peak_bytes );
+	double stream_rate = in.lookups / ( omp_get_wtime() - start );
+
+	if( mype == 0 )
+	{
+		printf("Streaming Lookups/s:          "); fancy_int(stream_rate);
+		printf("Peak Resident Grid (MB):      %.1lf of %.1lf\n", peak_bytes / 1024.0 / 1024.0, grid_bytes / 1024.0 / 1024.0);
+	}
+
+	// At most a band and the prefetched next band should be resident, plus a
+	// few pages per nuclide outside of them (the band boundaries, and the
+	// first steps of the grid searches). More means that pages are not being
+	// released (e.g., the grid file was not set up for streaming).
+	size_t page = sysconf(_SC_PAGESIZE);
+	size_t band_bytes = ( grid_bytes + n_bands - 1 ) / n_bands;
+	size_t bound = 2 * band_bytes + (size_t) in.n_isotopes * ( 4 + (size_t) log2(in.n_gridpoints) ) * page;
+	if( peak_bytes > bound && mype == 0 )
+		printf("Warning: the peak resident grid exceeds its bound of %.1lf MB!\n", bound / 1024.0 / 1024.0);
+
+	// Resident baseline: the same lookups with the whole grid faulted in
+	// first, if it fits in (half of) the host memory
+	size_t mem_bytes = (size_t) sysconf(_SC_PHYS_PAGES) * sysconf(_SC_PAGESIZE);
+	if( grid_bytes <= mem_bytes / 2 )
+	{
+		stream_touch_grid( SD );
+		start = omp_get_wtime();
+		unsigned long long resident_verification = stream_run_lookups( in, SD, band_start, n_bands, B, 0, NULL );
+		double resident_rate = in.lookups / ( omp_get_wtime() - start );
+		if( mype == 0 )
+		{
+			printf("Resident Lookups/s:           "); fancy_int(resident_rate);
+			printf("Streaming/Resident:           %.3lf\n", stream_rate / resident_rate);
+			if( resident_verification != verification )
+				printf("Warning: streaming and resident lookups gave different verification hashes!\n");
+		}
+	}
+	else if( mype == 0 )
+		printf("Resident baseline skipped (the grid does not fit in memory).\n");
+
+	free(B.energy);
+	free(B.mat);
+	free(B.sorted_energy);
+	free(B.sorted_mat);
+	free(B.bin_start);
+	free(band_start);
+
+	return verification;
+}
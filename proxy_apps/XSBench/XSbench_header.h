@@ -12,6 +12,10 @@
 #include<sys/time.h>
 #include<assert.h>
 #include<stdint.h>
+#include<limits.h>
+#include<fcntl.h>
+#include<sys/mman.h>
+#include<sys/stat.h>
 
 // Papi Header
 #ifdef PAPI
@@ -31,18 +35,89 @@
 #define NONE 0
 #define READ 1
 #define WRITE 2
+#define CACHE 3
 
 // Starting Seed
 #define STARTING_SEED 1070
 
+// Starting seed of the nuclide grid data
+#define GRID_SEED 42
+
+// Correlated history energies (-e correlated). Each collision leaves the
+// particle with a uniform fraction of its energy between HISTORY_ALPHA (close
+// to that of elastic scattering off U-238) and 1. Below HISTORY_E_CUTOFF the
+// particle is replaced by a new one, and it moves to a newly sampled material
+// with probability HISTORY_MOVE_PROB.
+#define HISTORY_ALPHA 0.98
+#define HISTORY_E_CUTOFF 1.0e-3
+#define HISTORY_MOVE_PROB 0.1
+
+// Per-particle nuclide grid search hints used by the history based simulation.
+// The slot count is a power of 2 that covers all H-M nuclides, and a hinted
+// search gallops at most this many steps (up to 255 gridpoints away, more than
+// a correlated history energy usually moves) before it falls back to bisection.
+#define NUCLIDE_HINT_SLOTS 512
+#define HINT_GALLOP_STEPS 8
+
+// Lowest bin boundary of the optional per-nuclide logarithmic energy grids
+// used by the nuclide grid. Bins are log spaced from here up to 1.0.
+#define LOG_GRID_E_MIN 1.0e-5
+
+// Radix sort of lookups by energy (event based kernel 1). Only the top
+// SORT_KEY_BITS bits of the energy are sorted on, which is enough to order the
+// lookups for locality, in passes of SORT_RADIX_BITS bits.
+#define SORT_KEY_BITS 16
+#define SORT_RADIX_BITS 8
+#define SORT_RADIX (1 << SORT_RADIX_BITS)
+#define SORT_BLOCKS 512
+
+// Materials with more nuclides than this are looked up cooperatively by a
+// whole team in event based kernel 2 (only the fuel, in H-M small and large)
+#define COOP_MIN_NUCS 32
+
+// Largest material row (nuclides per material) that event based kernel 3
+// stages in team-local memory (the H-M large fuel)
+#define MATERIAL_ROW_MAX 321
+
+// Binary file format. Bump the version whenever the layout of the file or of
+// the stored data structures changes.
+#define BINARY_FILE_MAGIC "XSBENCH"
+#define BINARY_FILE_VERSION 4
+#define BINARY_FILE_ALIGNMENT 4096
+
+// Checksum blocks (of 1 MB) hashed between page drops when validating a
+// streamed binary file
+#define BINARY_DROP_BLOCKS 64
+
+// Precision of the stored cross section data. When built with
+// MIXED_PRECISION, the five XS channels are stored as float while energies
+// stay double, so grid searches are exact and interpolation is still done
+// in double. This shrinks each gridpoint from 48 to 32 bytes.
+#ifdef MIXED_PRECISION
+typedef float xs_real;
+#else
+typedef double xs_real;
+#endif
+
+// Number of lookups compared against double precision data in mixed
+// precision builds
+#define PRECISION_CHECK_LOOKUPS 100000
+
+// Materials in the H-M benchmark (see Materials.c), which is also the
+// largest batch of materials per lookup (-M)
+#define N_MATERIALS 12
+
+// Lookups compared between batch and per-material lookups (-M)
+#define BATCH_CHECK_LOOKUPS 100000
+
 // Structures
 typedef struct{
 	double energy;
-	double total_xs;
-	double elastic_xs;
-	double absorbtion_xs;
-	double fission_xs;
-	double nu_fission_xs;
+	xs_real total_xs;
+	xs_real elastic_xs;
+	xs_real absorbtion_xs;
+	xs_real fission_xs;
+	xs_real nu_fission_xs;
 } NuclideGridPoint;
 
 typedef struct{
@@ -57,6 +132,12 @@ typedef struct{
 	int simulation_method;
 	int binary_mode;
 	int kernel_id;
+	char * cache_dir;
+	long stream_batch; // Lookups per batch in streaming mode (0: off)
+	int numa_compare;  // Compare NUMA placements of the grids on the host
+	long sort_batch;   // Lookups per batch in event based kernels 1 to 3
+	int batch_mats;    // Materials per lookup in batch lookup mode (0: off)
+	int correlated;    // History based: sample each energy from the previous one
 } Inputs;
 
 typedef struct{
@@ -73,12 +154,47 @@ typedef struct{
 	long length_index_grid;
 	int length_nuclide_grid;
 	int max_num_nucs;
+	int * nuc_mat_offsets;              // Length = length_nuc_mat_offsets (CSR, one row per nuclide)
+	int * nuc_mat_mats;                 // Length = length_nuc_mat_entries
+	double * nuc_mat_concs;             // Length = length_nuc_mat_entries
+	int length_nuc_mat_offsets;
+	int length_nuc_mat_entries;
 	double * p_energy_samples;
 	int length_p_energy_samples;
 	int * mat_samples;
 	int length_mat_samples;
 } SimulationData;
 
+// Header of the binary data file. It records the inputs that determine the
+// data structures, so that a file generated for a different problem is
+// rejected, the location of each array, and a checksum of the data. Every array starts on a
+// BINARY_FILE_ALIGNMENT boundary so that the file can be memory mapped and
+// the arrays used in place.
+typedef struct{
+	char magic[8];
+	int version;
+	int grid_type;
+	long n_isotopes;
+	long n_gridpoints;
+	int hash_bins;
+	int max_num_nucs;
+	int xs_bytes; // Size of each stored XS channel (i.e., the XS precision)
+	long length_num_nucs;
+	long length_concs;
+	long length_mats;
+	long length_nuclide_grid;
+	long length_index_grid;
+	long length_unionized_energy_array;
+	long offset_num_nucs;
+	long offset_concs;
+	long offset_mats;
+	long offset_nuclide_grid;
+	long offset_index_grid;
+	long offset_unionized_energy_array;
+	long file_size;
+	uint64_t checksum; // Of everything following the header
+} BinaryHeader;
+
 // io.c
 void logo(int version);
 void center_print(const char *s, int width);
@@ -90,6 +206,7 @@ void print_inputs(Inputs in, int nprocs, int version);
 int print_results( Inputs in, int mype, double runtime, int nprocs, unsigned long long vhash );
 void binary_write( Inputs in, SimulationData SD );
 SimulationData binary_read( Inputs in );
+SimulationData binary_cache_load( Inputs in, int mype );
 
 // Simulation.c
 unsigned long long run_event_based_simulation(Inputs in, SimulationData SD, int mype);
@@ -99,30 +216,61 @@ void calculate_micro_xs(   double p_energy, int nuc, long n_isotopes,
                            double *  egrid, int *  index_data,
                            NuclideGridPoint *  nuclide_grids,
                            long idx, double *  xs_vector, int grid_type, int hash_bins );
+void calculate_micro_xs_nucs( double p_energy, int n_nucs, int * nucs, long n_isotopes,
+                              long n_gridpoints,
+                              double *  egrid, int *  index_data,
+                              NuclideGridPoint *  nuclide_grids,
+                              long idx, double *  xs_vectors, int grid_type, int hash_bins );
 void calculate_macro_xs( double p_energy, int mat, long n_isotopes,
                          long n_gridpoints, int *  num_nucs,
                          double *  concs,
                          double *  egrid, int *  index_data,
                          NuclideGridPoint *  nuclide_grids,
                          int *  mats,
-                         double *  macro_xs_vector, int grid_type, int hash_bins, int max_num_nucs );
+                         double *  macro_xs_vector, int grid_type, int hash_bins, int max_num_nucs,
+                         int * hints );
+long calculate_grid_index( double p_energy, long n_isotopes, long n_gridpoints,
+                           double *  egrid, int grid_type, int hash_bins );
 long grid_search( long n, double quarry, double *  A);
 long grid_search_nuclide( long n, double quarry, NuclideGridPoint * A, long low, long high);
+long grid_search_nuclide_hint( long n, double quarry, NuclideGridPoint * A, long hint);
 int pick_mat( uint64_t * seed );
 double LCG_random_double(uint64_t * seed);
 uint64_t fast_forward_LCG(uint64_t seed, uint64_t n);
 unsigned long long run_event_based_simulation_optimization_1(Inputs in, SimulationData SD, int mype);
+unsigned long long run_event_based_simulation_optimization_2(Inputs in, SimulationData SD, int mype);
+unsigned long long run_event_based_simulation_optimization_3(Inputs in, SimulationData SD, int mype);
 
 // GridInit.c
 SimulationData grid_init_do_not_profile( Inputs in, int mype );
 
+// Precision.c
+void print_precision_error( Inputs in, SimulationData SD, int mype );
+
+// Numa.c
+unsigned long long run_numa_simulation(Inputs in, SimulationData SD, int mype);
+
+// Batch.c
+unsigned long long run_batch_simulation(Inputs in, SimulationData SD, int mype);
+
+// Streaming.c
+void * stream_map_grid( Inputs in, size_t bytes );
+void stream_attach_grid( int fd, long offset, void * grid, size_t bytes );
+unsigned long long run_stream_simulation(Inputs in, SimulationData SD, int mype);
+
 // XSutils.c
 int NGP_compare( const void * a, const void * b );
 int double_compare(const void * a, const void * b);
+void sort_nuclide_grid( NuclideGridPoint * A, long n, NuclideGridPoint * scratch );
 size_t estimate_mem_usage( Inputs in );
+SimulationData alloc_sim_data_on_device( SimulationData SD, int device );
+void copy_sim_data_to_device( SimulationData dst, SimulationData src, int dst_device, int src_device );
+void free_sim_data_on_device( SimulationData D, int device );
 
 // Materials.c
 int * load_num_nucs(long n_isotopes);
 int * load_mats( int * num_nucs, long n_isotopes, int * max_num_nucs );
 double * load_concs( int * num_nucs, int max_num_nucs );
+int * load_nuc_mats( int * num_nucs, int * mats, double * concs, int max_num_nucs, long n_isotopes,
+                     int ** nuc_mat_mats, double ** nuc_mat_concs, int * length_entries );
 #endif
@@ -26,6 +26,98 @@ int NGP_compare(const void * a, const void * b)
 		return 0;
 }
 
+// Sorts a nuclide grid by ascending energy, like qsort with NGP_compare, but
+// without the indirect comparator calls and struct copies. Unlike qsort, the
+// sort is stable: gridpoints with equal energies keep their generation order.
+// (qsort made no guarantee about their order, so with equal energies the two
+// can order gridpoints differently.)
+// It is an LSD radix sort over the bit patterns of the energies, which
+// order the same way as the values themselves because energies are never
+// negative. "scratch" must hold at least n gridpoints.
+void sort_nuclide_grid( NuclideGridPoint * A, long n, NuclideGridPoint * scratch )
+{
+	NuclideGridPoint * src = A;
+	NuclideGridPoint * dst = scratch;
+
+	for( int shift = 0; shift < 64; shift += 8 )
+	{
+		long count[256] = {0};
+		for( long i = 0; i < n; i++ )
+		{
+			uint64_t key;
+			memcpy(&key, &src[i].energy, sizeof(uint64_t));
+			count[(key >> shift) & 0xFF]++;
+		}
+
+		// Skip digits that are the same for all energies (e.g., the exponent)
+		if( count[0] == n )
+			continue;
+		int trivial = 0;
+		for( int d = 1; d < 256; d++ )
+			if( count[d] == n )
+				trivial = 1;
+		if( trivial )
+			continue;
+
+		long offset = 0;
+		for( int d = 0; d < 256; d++ )
+		{
+			long c = count[d];
+			count[d] = offset;
+			offset += c;
+		}
+
+		for( long i = 0; i < n; i++ )
+		{
+			uint64_t key;
+			memcpy(&key, &src[i].energy, sizeof(uint64_t));
+			dst[count[(key >> shift) & 0xFF]++] = src[i];
+		}
+
+		NuclideGridPoint * tmp = src;
+		src = dst;
+		dst = tmp;
+	}
+
+	if( src != A )
+		memcpy( A, src, n * sizeof(NuclideGridPoint) );
+}
+
+// Allocates the lookup arrays of SD (see run_event_based_simulation) on a
+// device. The lengths are those of SD, and the contents are left uninitialized.
+SimulationData alloc_sim_data_on_device( SimulationData SD, int device )
+{
+	SimulationData D = SD;
+	D.num_nucs = (int *) omp_target_alloc(SD.length_num_nucs*sizeof(int), device);
+	D.concs = (double *) omp_target_alloc(SD.length_concs*sizeof(double), device);
+	D.mats = (int *) omp_target_alloc(SD.length_mats*sizeof(int), device);
+	D.unionized_energy_array = (double *) omp_target_alloc(SD.length_unionized_energy_array*sizeof(double), device);
+	D.index_grid = (int *) omp_target_alloc(SD.length_index_grid*sizeof(int), device);
+	D.nuclide_grid = (NuclideGridPoint *) omp_target_alloc(SD.length_nuclide_grid*sizeof(NuclideGridPoint), device);
+	return D;
+}
+
+// Copies the lookup arrays of src (on src_device, which may be the host) to
+// those of dst (on dst_device)
+void copy_sim_data_to_device( SimulationData dst, SimulationData src, int dst_device, int src_device )
+{
+	omp_target_memcpy(dst.num_nucs, src.num_nucs, src.length_num_nucs*sizeof(int), 0 , 0, dst_device, src_device);
+	omp_target_memcpy(dst.concs, src.concs, src.length_concs*sizeof(double), 0 , 0, dst_device, src_device);
+	omp_target_memcpy(dst.mats, src.mats, src.length_mats*sizeof(int), 0 , 0, dst_device, src_device);
+	omp_target_memcpy(dst.unionized_energy_array, src.unionized_energy_array, src.length_unionized_energy_array*sizeof(double), 0 , 0, dst_device, src_device);
+	omp_target_memcpy(dst.index_grid, src.index_grid, src.length_index_grid*sizeof(int), 0 , 0, dst_device, src_device);
+	omp_target_memcpy(dst.nuclide_grid, src.nuclide_grid, src.length_nuclide_grid*sizeof(NuclideGridPoint), 0 , 0, dst_device, src_device);
+}
+
+void free_sim_data_on_device( SimulationData D, int device )
+{
+	omp_target_free(D.num_nucs, device);
+	omp_target_free(D.concs, device);
+	omp_target_free(D.mats, device);
+	omp_target_free(D.unionized_energy_array, device);
+	omp_target_free(D.index_grid, device);
+	omp_target_free(D.nuclide_grid, device);
+}
 
 size_t estimate_mem_usage( Inputs in )
 {
@@ -33,12 +125,13 @@ size_t estimate_mem_usage( Inputs in )
 	size_t all_nuclide_grids   = in.n_isotopes * single_nuclide_grid;
 	size_t size_UEG            = in.n_isotopes*in.n_gridpoints*sizeof(double) + in.n_isotopes*in.n_gridpoints*in.n_isotopes*sizeof(int);
 	size_t size_hash_grid      = in.hash_bins * in.n_isotopes * sizeof(int);
+	size_t size_log_grids      = ( in.hash_bins > 0 ) ? ( in.hash_bins + 1 ) * in.n_isotopes * sizeof(int) : 0;
 	size_t memtotal;
 
 	if( in.grid_type == UNIONIZED )
 		memtotal          = all_nuclide_grids + size_UEG;
 	else if( in.grid_type == NUCLIDE )
-		memtotal          = all_nuclide_grids;
+		memtotal          = all_nuclide_grids + size_log_grids;
 	else
 		memtotal          = all_nuclide_grids + size_hash_grid;
 
@@ -89,6 +89,16 @@ int print_results( Inputs in, int mype, double runtime, int nprocs,
 		small = 945990;
 		large = 952131;
 	}
+	else if( in.simulation_method == HISTORY_BASED && in.correlated )
+	{
+		// Produced by this code itself (there is no independent reference),
+		// with "-m history -e correlated -s small|large" and the default
+		// particles and lookups. The same values were obtained with 1 and 4
+		// threads, with -k 0 and -k 1, and with the nuclide, unionized and
+		// hash grids.
+		small = 921517;
+		large = 908597;
+	}
 	else if( in.simulation_method == HISTORY_BASED )
 	{
 		small = 941535;
@@ -107,8 +117,15 @@ int print_results( Inputs in, int mype, double runtime, int nprocs,
 
 	if(mype == 0 )
 	{
+		// The reference checksums are for double precision XS data. With
+		// float XS data, a few lookups may pick a different maximum channel.
+		#ifdef MIXED_PRECISION
+		if( is_invalid_result )
+			printf("Verification checksum: %llu (Mixed precision - not comparable to reference)\n", vhash);
+		#else
 		if( is_invalid_result )
 			printf("Verification checksum: %llu (WARNING - INAVALID CHECKSUM!)\n", vhash);
+		#endif
 		else
 			printf("Verification checksum: %llu (Valid)\n", vhash);
 		border_print();
@@ -146,6 +163,11 @@ void print_inputs(Inputs in, int nprocs, int version )
 		printf("Hash Bins:                    ");
 		fancy_int(in.hash_bins);
 	}
+	if( in.grid_type == NUCLIDE && in.hash_bins > 0 )
+	{
+		printf("Log Grid Bins (per Nuclide):  ");
+		fancy_int(in.hash_bins);
+	}
 	if( in.grid_type == UNIONIZED )
 	{
 		printf("Unionized Energy Gridpoints:  ");
@@ -155,21 +177,41 @@ void print_inputs(Inputs in, int nprocs, int version )
 	{
 		printf("Particle Histories:           "); fancy_int(in.particles);
 		printf("XS Lookups per Particle:      "); fancy_int(in.lookups);
+		printf("History Energies:             %s\n", in.correlated ? "Correlated" : "Independent");
 	}
 	printf("Total XS Lookups:             "); fancy_int(in.lookups);
+	#ifdef MIXED_PRECISION
+	printf("XS Precision:                 Mixed (float XS, double energy)\n");
+	#else
+	printf("XS Precision:                 Double\n");
+	#endif
 	#ifdef MPI
 	printf("MPI Ranks:                    %d\n", nprocs);
 	printf("Mem Usage per MPI Rank (MB):  "); fancy_int(mem_tot);
 	#else
 	printf("Est. Memory Usage (MB):       "); fancy_int(mem_tot);
 	#endif
+	if( in.stream_batch > 0 )
+	{
+		printf("Streaming Batch Size:         "); fancy_int(in.stream_batch);
+	}
+	else if( in.numa_compare )
+		printf("NUMA Placement:               Compare (host)\n");
+	else if( in.batch_mats > 0 )
+		printf("Batch Lookups:                %d materials per energy (host)\n", in.batch_mats);
+	else if( in.simulation_method == EVENT_BASED && in.kernel_id >= 1 && in.kernel_id <= 3 )
+	{
+		printf("Lookup Batch Size:            "); fancy_int(in.sort_batch);
+	}
 	printf("Binary File Mode:             ");
 	if( in.binary_mode == NONE )
 		printf("Off\n");
 	else if( in.binary_mode == READ)
 		printf("Read\n");
-	else
+	else if( in.binary_mode == WRITE)
 		printf("Write\n");
+	else
+		printf("Cache (%s)\n", in.cache_dir);
 	border_print();
 	center_print("INITIALIZATION - DO NOT PROFILE", 79);
 	border_print();
@@ -214,9 +256,21 @@ void print_CLI_error(void)
 	printf("  -G <grid type>           Grid search type (unionized, nuclide, hash). Defaults to unionized.\n");
 	printf("  -p <particles>           Number of particle histories\n");
 	printf("  -l <lookups>             History Based: Number of Cross-section (XS) lookups per particle. Event Based: Total number of XS lookups.\n");
-	printf("  -h <hash bins>           Number of hash bins (only relevant when used with \"-G hash\")\n");
+	printf("  -h <hash bins>           Number of hash bins (only relevant when used with \"-G hash\" or \"-G nuclide\")\n");
+	printf("                           With \"-G nuclide\", number of bins of the per-nuclide log grids used to accelerate searches (defaults to 0, no log grids).\n");
 	printf("  -b <binary mode>         Read or write all data structures to file. If reading, this will skip initialization phase. (read, write)\n");
+	printf("  -c <cache dir>           Load all data structures from the dataset cache in this directory, initializing and caching them if not found.\n");
+	printf("  -S <batch size>          Out-of-core streaming: keep the nuclide grid in a memory-mapped file and run lookups on the host in energy-sorted batches of this size.\n");
+	printf("  -N                       Run event based lookups on the host with interleaved, first-touch and per-node replicated grids, and compare lookups/s.\n");
 	printf("  -k <kernel ID>           Specifies which kernel to run. 0 is baseline, 1, 2, etc are optimized variants. (0 is default.)\n");
+	printf("                           Event Based: 1 sorts each batch of lookups by energy before running it.\n");
+	printf("                                        2 runs each fuel (heavy material) lookup on a whole team.\n");
+	printf("                                        3 buckets lookups by material and runs one kernel per material.\n");
+	printf("                           History Based: 1 starts nuclide grid searches from the last index found for each nuclide (use with \"-G nuclide -e correlated\").\n");
+	printf("  -e <energies>            History Based: energies of the lookups of a particle (independent, correlated). Defaults to independent.\n");
+	printf("                           Independent energies are sampled anew for each lookup. Correlated energies slow down from the previous one.\n");
+	printf("  -M <materials>           Run event based lookups on the host, each against this many materials (1 to 12) at once, with and without sharing the micro XS of common nuclides, and compare lookups/s.\n");
+	printf("  -B <batch size>          Number of lookups run at a time by event based kernels 1 to 3 (defaults to 4194304).\n");
 	printf("Default is equivalent to: -m history -s large -l 34 -p 500000 -G unionized\n");
 	printf("See readme for full description of default run values\n");
 	exit(4);
@@ -255,6 +309,24 @@ Inputs read_CLI( int argc, char * argv[] )
 	
 	// defaults to baseline kernel
 	input.kernel_id = 0;
+
+	// defaults to no dataset cache
+	input.cache_dir = NULL;
+
+	// defaults to no streaming
+	input.stream_batch = 0;
+
+	// defaults to no NUMA placement comparison
+	input.numa_compare = 0;
+
+	// defaults to no batch lookups
+	input.batch_mats = 0;
+
+	// defaults to independent history energies (as in the reference checksums)
+	input.correlated = 0;
+
+	// defaults to 4M lookups per batch (event based kernels 1 to 3)
+	input.sort_batch = 1L << 22;
 	
 	// defaults to H-M Large benchmark
 	input.HM = (char *) malloc( 6 * sizeof(char) );
@@ -267,6 +339,7 @@ Inputs read_CLI( int argc, char * argv[] )
 	
 	// Check if user sets these
 	int user_g = 0;
+	int user_h = 0;
 
 	int default_lookups = 1;
 	int default_particles = 1;
@@ -326,7 +399,10 @@ Inputs read_CLI( int argc, char * argv[] )
 		else if( strcmp(arg, "-h") == 0 )
 		{
 			if( ++i < argc )
+			{
+				user_h = 1;
 				input.hash_bins = atoi(argv[i]);
+			}
 			else
 				print_CLI_error();
 		}
@@ -383,6 +459,62 @@ Inputs read_CLI( int argc, char * argv[] )
 			else
 				print_CLI_error();
 		}
+		// dataset cache directory (-c)
+		else if( strcmp(arg, "-c") == 0 )
+		{
+			if( ++i < argc )
+			{
+				input.cache_dir = argv[i];
+				input.binary_mode = CACHE;
+			}
+			else
+				print_CLI_error();
+		}
+		// out-of-core streaming batch size (-S)
+		else if( strcmp(arg, "-S") == 0 )
+		{
+			if( ++i < argc )
+				input.stream_batch = atol(argv[i]);
+			else
+				print_CLI_error();
+		}
+		// NUMA placement comparison (-N)
+		else if( strcmp(arg, "-N") == 0 )
+		{
+			input.numa_compare = 1;
+		}
+		// materials per batch lookup (-M)
+		else if( strcmp(arg, "-M") == 0 )
+		{
+			if( ++i < argc )
+				input.batch_mats = atoi(argv[i]);
+			else
+				print_CLI_error();
+		}
+		// energy sorted batch size (-B)
+		else if( strcmp(arg, "-B") == 0 )
+		{
+			if( ++i < argc )
+				input.sort_batch = atol(argv[i]);
+			else
+				print_CLI_error();
+		}
+		// history energies (-e)
+		else if( strcmp(arg, "-e") == 0 )
+		{
+			char * energies;
+			if( ++i < argc )
+				energies = argv[i];
+			else
+				print_CLI_error();
+
+			if( strcmp(energies, "independent") == 0 )
+				input.correlated = 0;
+			else if( strcmp(energies, "correlated") == 0 )
+				input.correlated = 1;
+			else
+				print_CLI_error();
+		}
 		// kernel optimization selection (-k)
 		else if( strcmp(arg, "-k") == 0 )
 		{
@@ -415,9 +547,43 @@ Inputs read_CLI( int argc, char * argv[] )
 	if( input.lookups < 1 )
 		print_CLI_error();
 
+	// The nuclide grid has no log grids unless the user asks for them
+	if( input.grid_type == NUCLIDE && user_h == 0 )
+		input.hash_bins = 0;
+
 	// Validate Hash Bins 
-	if( input.hash_bins < 1 )
+	if( input.hash_bins < 0 || ( input.grid_type == HASH && input.hash_bins < 1 ) )
+		print_CLI_error();
+
+	// Validate batch size (batch offsets are stored as ints)
+	if( input.sort_batch < 1 || input.sort_batch > INT_MAX )
+		print_CLI_error();
+
+	// Validate streaming mode (the unionized grid cannot be streamed, as its
+	// index grid is far larger than the nuclide grid itself)
+	if( input.stream_batch < 0 )
+		print_CLI_error();
+	if( input.stream_batch > 0 && ( input.grid_type == UNIONIZED || input.simulation_method != EVENT_BASED ) )
+	{
+		printf("Streaming mode requires \"-m event\" and \"-G nuclide\" or \"-G hash\".\n");
+		exit(4);
+	}
+
+	// Validate NUMA placement comparison mode
+	if( input.numa_compare && ( input.simulation_method != EVENT_BASED || input.stream_batch > 0 ) )
+	{
+		printf("NUMA placement comparison requires \"-m event\" and no streaming.\n");
+		exit(4);
+	}
+
+	// Validate batch lookup mode
+	if( input.batch_mats < 0 || input.batch_mats > N_MATERIALS )
 		print_CLI_error();
+	if( input.batch_mats > 0 && ( input.simulation_method != EVENT_BASED || input.stream_batch > 0 || input.numa_compare ) )
+	{
+		printf("Batch lookups require \"-m event\", and no streaming or NUMA comparison.\n");
+		exit(4);
+	}
 	
 	// Validate HM size
 	if( strcasecmp(input.HM, "small") != 0 &&
@@ -439,56 +605,314 @@ Inputs read_CLI( int argc, char * argv[] )
 	return input;
 }
 
-void binary_write( Inputs in, SimulationData SD )
+// Rounds a file offset up to the next array boundary of the binary file
+static long binary_align( long offset )
 {
-	char * fname = "XS_data.dat";
-	printf("Writing all data structures to binary file %s...\n", fname);
-	FILE * fp = fopen(fname, "w");
+	return ( offset + BINARY_FILE_ALIGNMENT - 1 ) / BINARY_FILE_ALIGNMENT * BINARY_FILE_ALIGNMENT;
+}
 
-	// Write SimulationData Object. Include pointers, even though we won't be using them.
-	fwrite(&SD, sizeof(SimulationData), 1, fp);
+// Checksum of "n" bytes of binary file data. The data is hashed in 1 MB blocks
+// in parallel (FNV-1a over 64-bit words), and the block hashes are then
+// combined in order, so the result does not depend on the number of threads.
+//
+// If "drop_fd" is not -1, "data" is a page aligned mapping of that file at
+// offset "drop_offset", and the data is hashed BINARY_DROP_BLOCKS blocks at a
+// time, dropping the pages of each chunk from the mapping and from the page
+// cache once it is hashed (so that validating a streamed grid does not make
+// all of it resident).
+static uint64_t binary_checksum( char * data, long n, int drop_fd, long drop_offset )
+{
+	const uint64_t prime = 1099511628211ULL;
+	const long block = 1 << 20;
+	long n_blocks = ( n + block - 1 ) / block;
+	uint64_t * block_hash = (uint64_t *) malloc( (n_blocks + 1) * sizeof(uint64_t));
+	assert(block_hash != NULL);
+
+	long chunk = ( drop_fd != -1 ) ? BINARY_DROP_BLOCKS : n_blocks;
+	for( long first = 0; first < n_blocks; first += chunk )
+	{
+		long last = ( first + chunk < n_blocks ) ? first + chunk : n_blocks;
+
+		#pragma omp parallel for schedule(dynamic)
+		for( long b = first; b < last; b++ )
+		{
+			char * p = data + b * block;
+			long len = ( b == n_blocks - 1 ) ? n - b * block : block;
+			uint64_t hash = 14695981039346656037ULL;
+			long w = 0;
+			for( ; w + 8 <= len; w += 8 )
+			{
+				uint64_t word;
+				memcpy(&word, p + w, sizeof(uint64_t));
+				hash = ( hash ^ word ) * prime;
+			}
+			for( ; w < len; w++ )
+				hash = ( hash ^ (unsigned char) p[w] ) * prime;
+			block_hash[b] = hash;
+		}
 
-	// Write heap arrays in SimulationData Object
-	fwrite(SD.num_nucs,       sizeof(int), SD.length_num_nucs, fp);
-	fwrite(SD.concs,          sizeof(double), SD.length_concs, fp);
-	fwrite(SD.mats,           sizeof(int), SD.length_mats, fp);
-	fwrite(SD.nuclide_grid,   sizeof(NuclideGridPoint), SD.length_nuclide_grid, fp); 
-	fwrite(SD.index_grid, sizeof(int), SD.length_index_grid, fp);
-	fwrite(SD.unionized_energy_array, sizeof(double), SD.length_unionized_energy_array, fp);
+		if( drop_fd != -1 )
+		{
+			long start = first * block;
+			long len   = ( ( last * block < n ) ? last * block : n ) - start;
+			madvise(data + start, len, MADV_DONTNEED);
+			posix_fadvise(drop_fd, drop_offset + start, len, POSIX_FADV_DONTNEED);
+		}
+	}
 
-	fclose(fp);
+	uint64_t hash = 14695981039346656037ULL;
+	for( long b = 0; b < n_blocks; b++ )
+		hash = ( hash ^ block_hash[b] ) * prime;
+
+	free(block_hash);
+	return hash;
+}
+
+// Writes all data structures to a binary file. Returns 0 on success.
+static int binary_save( Inputs in, SimulationData SD, const char * fname )
+{
+	// Describe the problem and lay out the arrays, each on an aligned offset
+	BinaryHeader H;
+	memset(&H, 0, sizeof(BinaryHeader));
+	strcpy(H.magic, BINARY_FILE_MAGIC);
+	H.version                       = BINARY_FILE_VERSION;
+	H.grid_type                     = in.grid_type;
+	H.n_isotopes                    = in.n_isotopes;
+	H.n_gridpoints                  = in.n_gridpoints;
+	H.hash_bins                     = in.hash_bins;
+	H.max_num_nucs                  = SD.max_num_nucs;
+	H.xs_bytes                      = sizeof(xs_real);
+	H.length_num_nucs               = SD.length_num_nucs;
+	H.length_concs                  = SD.length_concs;
+	H.length_mats                   = SD.length_mats;
+	H.length_nuclide_grid           = SD.length_nuclide_grid;
+	H.length_index_grid             = SD.length_index_grid;
+	H.length_unionized_energy_array = SD.length_unionized_energy_array;
+
+	H.offset_num_nucs               = binary_align(sizeof(BinaryHeader));
+	H.offset_concs                  = binary_align(H.offset_num_nucs     + H.length_num_nucs     * sizeof(int));
+	H.offset_mats                   = binary_align(H.offset_concs        + H.length_concs        * sizeof(double));
+	H.offset_nuclide_grid           = binary_align(H.offset_mats         + H.length_mats         * sizeof(int));
+	H.offset_index_grid             = binary_align(H.offset_nuclide_grid + H.length_nuclide_grid * sizeof(NuclideGridPoint));
+	H.offset_unionized_energy_array = binary_align(H.offset_index_grid   + H.length_index_grid   * sizeof(int));
+	H.file_size                     = H.offset_unionized_energy_array + H.length_unionized_energy_array * sizeof(double);
+
+	// The file is assembled in a (zero filled) shared mapping, so that the
+	// checksum can be taken over exactly the bytes that end up on disk.
+	int fd = open(fname, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if( fd < 0 )
+		return 1;
+	if( ftruncate(fd, H.file_size) != 0 )
+	{
+		close(fd);
+		return 1;
+	}
+	char * base = (char *) mmap(NULL, H.file_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if( base == MAP_FAILED )
+		return 1;
+
+	memcpy(base + H.offset_num_nucs,               SD.num_nucs,               H.length_num_nucs               * sizeof(int));
+	memcpy(base + H.offset_concs,                  SD.concs,                  H.length_concs                  * sizeof(double));
+	memcpy(base + H.offset_mats,                   SD.mats,                   H.length_mats                   * sizeof(int));
+	memcpy(base + H.offset_nuclide_grid,           SD.nuclide_grid,           H.length_nuclide_grid           * sizeof(NuclideGridPoint));
+	memcpy(base + H.offset_index_grid,             SD.index_grid,             H.length_index_grid             * sizeof(int));
+	memcpy(base + H.offset_unionized_energy_array, SD.unionized_energy_array, H.length_unionized_energy_array * sizeof(double));
+
+	H.checksum = binary_checksum(base + H.offset_num_nucs, H.file_size - H.offset_num_nucs, -1, 0);
+	memcpy(base, &H, sizeof(BinaryHeader));
+
+	int err = msync(base, H.file_size, MS_SYNC);
+	munmap(base, H.file_size);
+
+	return err != 0;
+}
+
+// Maps a binary file and points all arrays of SD directly into the mapping
+// (i.e., nothing is copied into separately allocated buffers). Fails if the
+// file was not written by this version of XSBench for the same problem, or
+// if its data does not match the stored checksum. Returns 0 on success,
+// otherwise prints the reason and returns nonzero.
+//
+// In streaming mode (-S), the nuclide grid is streamed from this mapping: the
+// file is kept open for the streaming code (see stream_attach_grid), and the
+// checksum drops the pages it reads, so the file starts out non-resident.
+static int binary_load( Inputs in, const char * fname, SimulationData * SD )
+{
+	memset(SD, 0, sizeof(SimulationData));
+
+	int fd = open(fname, O_RDONLY);
+	if( fd < 0 )
+	{
+		printf("Could not open binary file %s.\n", fname);
+		return 1;
+	}
+
+	BinaryHeader H;
+	struct stat st;
+	if( read(fd, &H, sizeof(BinaryHeader)) != sizeof(BinaryHeader) || fstat(fd, &st) != 0 )
+	{
+		printf("Could not read binary file %s.\n", fname);
+		close(fd);
+		return 1;
+	}
+
+	if( strncmp(H.magic, BINARY_FILE_MAGIC, sizeof(H.magic)) != 0 || H.version != BINARY_FILE_VERSION )
+	{
+		printf("%s is not a version %d XSBench binary file.\n", fname, BINARY_FILE_VERSION);
+		close(fd);
+		return 1;
+	}
+
+	if( H.grid_type != in.grid_type || H.n_isotopes != in.n_isotopes || H.n_gridpoints != in.n_gridpoints ||
+	    ( in.grid_type != UNIONIZED && H.hash_bins != in.hash_bins ) )
+	{
+		printf("%s was written for a different problem (grid type %d, %ld isotopes, %ld gridpoints, %d hash bins).\n",
+		       fname, H.grid_type, H.n_isotopes, H.n_gridpoints, H.hash_bins);
+		close(fd);
+		return 1;
+	}
+
+	if( H.xs_bytes != sizeof(xs_real) )
+	{
+		printf("%s holds %d byte XS data, but this build uses %d byte XS data.\n",
+		       fname, H.xs_bytes, (int) sizeof(xs_real));
+		close(fd);
+		return 1;
+	}
+
+	if( st.st_size != H.file_size )
+	{
+		printf("Binary file %s has the wrong size.\n", fname);
+		close(fd);
+		return 1;
+	}
+
+	// The mapping is private and read-only: the simulation never writes to
+	// these arrays, and the file stays untouched.
+	char * base = (char *) mmap(NULL, H.file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	int streaming = ( in.stream_batch > 0 );
+	if( !streaming )
+		close(fd);
+	if( base == MAP_FAILED )
+	{
+		printf("Could not map binary file %s.\n", fname);
+		if( streaming )
+			close(fd);
+		return 1;
+	}
+
+	if( binary_checksum(base + H.offset_num_nucs, H.file_size - H.offset_num_nucs,
+	                    streaming ? fd : -1, H.offset_num_nucs) != H.checksum )
+	{
+		printf("Binary file %s is corrupted (checksum mismatch).\n", fname);
+		munmap(base, H.file_size);
+		if( streaming )
+			close(fd);
+		return 1;
+	}
+
+	if( streaming )
+		stream_attach_grid( fd, H.offset_nuclide_grid, base + H.offset_nuclide_grid,
+		                    H.length_nuclide_grid * sizeof(NuclideGridPoint) );
+
+	SD->max_num_nucs                  = H.max_num_nucs;
+	SD->length_num_nucs               = H.length_num_nucs;
+	SD->length_concs                  = H.length_concs;
+	SD->length_mats                   = H.length_mats;
+	SD->length_nuclide_grid           = H.length_nuclide_grid;
+	SD->length_index_grid             = H.length_index_grid;
+	SD->length_unionized_energy_array = H.length_unionized_energy_array;
+
+	SD->num_nucs               = (int *)              (base + H.offset_num_nucs);
+	SD->concs                  = (double *)           (base + H.offset_concs);
+	SD->mats                   = (int *)              (base + H.offset_mats);
+	SD->nuclide_grid           = (NuclideGridPoint *) (base + H.offset_nuclide_grid);
+	SD->index_grid             = (int *)              (base + H.offset_index_grid);
+	SD->unionized_energy_array = (double *)           (base + H.offset_unionized_energy_array);
+
+	return 0;
+}
+
+void binary_write( Inputs in, SimulationData SD )
+{
+	char * fname = "XS_data.dat";
+	printf("Writing all data structures to binary file %s...\n", fname);
+	if( binary_save(in, SD, fname) != 0 )
+	{
+		printf("Error: failed writing binary file %s!\n", fname);
+		exit(1);
+	}
 }
 
 SimulationData binary_read( Inputs in )
 {
 	SimulationData SD;
-	
 	char * fname = "XS_data.dat";
 	printf("Reading all data structures from binary file %s...\n", fname);
+	if( binary_load(in, fname, &SD) != 0 )
+	{
+		printf("Error: failed reading binary file %s!\n", fname);
+		exit(1);
+	}
+	return SD;
+}
+
+// Loads all data structures from the dataset cache. Datasets are stored as
+// binary files named after a hash of the inputs that determine them, so that
+// any number of runs of the same problem share one file. On a miss (or if
+// the cached file fails validation) the data is initialized as usual and
+// written to the cache. Files are written under a temporary name and then
+// renamed, so that concurrent runs never see a partially written dataset.
+SimulationData binary_cache_load( Inputs in, int mype )
+{
+	SimulationData SD;
 
-	FILE * fp = fopen(fname, "r");
-	assert(fp != NULL);
-
-	// Read SimulationData Object. Include pointers, even though we won't be using them.
-	fread(&SD, sizeof(SimulationData), 1, fp);
-
-	// Allocate space for arrays on heap
-	SD.num_nucs = (int *) malloc(SD.length_num_nucs * sizeof(int));
-	SD.concs = (double *) malloc(SD.length_concs * sizeof(double));
-	SD.mats = (int *) malloc(SD.length_mats * sizeof(int));
-	SD.nuclide_grid = (NuclideGridPoint *) malloc(SD.length_nuclide_grid * sizeof(NuclideGridPoint));
-	SD.index_grid = (int *) malloc( SD.length_index_grid * sizeof(int));
-	SD.unionized_energy_array = (double *) malloc( SD.length_unionized_energy_array * sizeof(double));
-
-	// Read heap arrays into SimulationData Object
-	fread(SD.num_nucs,       sizeof(int), SD.length_num_nucs, fp);
-	fread(SD.concs,          sizeof(double), SD.length_concs, fp);
-	fread(SD.mats,           sizeof(int), SD.length_mats, fp);
-	fread(SD.nuclide_grid,   sizeof(NuclideGridPoint), SD.length_nuclide_grid, fp); 
-	fread(SD.index_grid, sizeof(int), SD.length_index_grid, fp);
-	fread(SD.unionized_energy_array, sizeof(double), SD.length_unionized_energy_array, fp);
-
-	fclose(fp);
+	// Cache key. The number of hash bins only matters for the hash grid and
+	// for the log grids of the nuclide grid.
+	struct{
+		char magic[8];
+		long version;
+		long grid_type;
+		long n_isotopes;
+		long n_gridpoints;
+		long hash_bins;
+		long xs_bytes;
+	} key;
+	memset(&key, 0, sizeof(key));
+	strcpy(key.magic, BINARY_FILE_MAGIC);
+	key.version      = BINARY_FILE_VERSION;
+	key.grid_type    = in.grid_type;
+	key.n_isotopes   = in.n_isotopes;
+	key.n_gridpoints = in.n_gridpoints;
+	key.hash_bins    = ( in.grid_type != UNIONIZED ) ? in.hash_bins : 0;
+	key.xs_bytes     = sizeof(xs_real);
+
+	char fname[4096];
+	snprintf(fname, sizeof(fname), "%s/xsbench-%016llx.dat", in.cache_dir,
+	         (unsigned long long) binary_checksum((char *) &key, sizeof(key), -1, 0));
+
+	if( mype == 0 ) printf("Looking up dataset cache file %s...\n", fname);
+	if( binary_load(in, fname, &SD) == 0 )
+	{
+		if( mype == 0 ) printf("Loaded all data structures from the dataset cache.\n");
+		return SD;
+	}
+
+	SD = grid_init_do_not_profile( in, mype );
+
+	if( mype == 0 )
+	{
+		char tmp_fname[4096 + 32];
+		snprintf(tmp_fname, sizeof(tmp_fname), "%s.tmp.%d", fname, (int) getpid());
+		printf("Adding all data structures to the dataset cache...\n");
+		if( ( mkdir(in.cache_dir, 0755) != 0 && access(in.cache_dir, W_OK) != 0 ) ||
+		    binary_save(in, SD, tmp_fname) != 0 || rename(tmp_fname, fname) != 0 )
+		{
+			printf("WARNING - could not write dataset cache file %s!\n", fname);
+			unlink(tmp_fname);
+		}
+	}
 
 	return SD;
 }